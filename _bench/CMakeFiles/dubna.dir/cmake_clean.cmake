@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/dubna.dir/main.cpp.o"
+  "CMakeFiles/dubna.dir/main.cpp.o.d"
+  "dubna"
+  "dubna.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/dubna.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,33 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/arithmetic.cpp" "CMakeFiles/simulator.dir/arithmetic.cpp.o" "gcc" "CMakeFiles/simulator.dir/arithmetic.cpp.o.d"
+  "/root/repo/assembler.cpp" "CMakeFiles/simulator.dir/assembler.cpp.o" "gcc" "CMakeFiles/simulator.dir/assembler.cpp.o.d"
+  "/root/repo/besm6_arch.cpp" "CMakeFiles/simulator.dir/besm6_arch.cpp.o" "gcc" "CMakeFiles/simulator.dir/besm6_arch.cpp.o.d"
+  "/root/repo/disk.cpp" "CMakeFiles/simulator.dir/disk.cpp.o" "gcc" "CMakeFiles/simulator.dir/disk.cpp.o.d"
+  "/root/repo/drum.cpp" "CMakeFiles/simulator.dir/drum.cpp.o" "gcc" "CMakeFiles/simulator.dir/drum.cpp.o.d"
+  "/root/repo/e64.cpp" "CMakeFiles/simulator.dir/e64.cpp.o" "gcc" "CMakeFiles/simulator.dir/e64.cpp.o.d"
+  "/root/repo/encoding.cpp" "CMakeFiles/simulator.dir/encoding.cpp.o" "gcc" "CMakeFiles/simulator.dir/encoding.cpp.o.d"
+  "/root/repo/extracode.cpp" "CMakeFiles/simulator.dir/extracode.cpp.o" "gcc" "CMakeFiles/simulator.dir/extracode.cpp.o.d"
+  "/root/repo/jit.cpp" "CMakeFiles/simulator.dir/jit.cpp.o" "gcc" "CMakeFiles/simulator.dir/jit.cpp.o.d"
+  "/root/repo/machine.cpp" "CMakeFiles/simulator.dir/machine.cpp.o" "gcc" "CMakeFiles/simulator.dir/machine.cpp.o.d"
+  "/root/repo/memory.cpp" "CMakeFiles/simulator.dir/memory.cpp.o" "gcc" "CMakeFiles/simulator.dir/memory.cpp.o.d"
+  "/root/repo/processor.cpp" "CMakeFiles/simulator.dir/processor.cpp.o" "gcc" "CMakeFiles/simulator.dir/processor.cpp.o.d"
+  "/root/repo/session.cpp" "CMakeFiles/simulator.dir/session.cpp.o" "gcc" "CMakeFiles/simulator.dir/session.cpp.o.d"
+  "/root/repo/superblock.cpp" "CMakeFiles/simulator.dir/superblock.cpp.o" "gcc" "CMakeFiles/simulator.dir/superblock.cpp.o.d"
+  "/root/repo/trace.cpp" "CMakeFiles/simulator.dir/trace.cpp.o" "gcc" "CMakeFiles/simulator.dir/trace.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,39 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/simulator.dir/arithmetic.cpp.o"
+  "CMakeFiles/simulator.dir/arithmetic.cpp.o.d"
+  "CMakeFiles/simulator.dir/assembler.cpp.o"
+  "CMakeFiles/simulator.dir/assembler.cpp.o.d"
+  "CMakeFiles/simulator.dir/besm6_arch.cpp.o"
+  "CMakeFiles/simulator.dir/besm6_arch.cpp.o.d"
+  "CMakeFiles/simulator.dir/disk.cpp.o"
+  "CMakeFiles/simulator.dir/disk.cpp.o.d"
+  "CMakeFiles/simulator.dir/drum.cpp.o"
+  "CMakeFiles/simulator.dir/drum.cpp.o.d"
+  "CMakeFiles/simulator.dir/e64.cpp.o"
+  "CMakeFiles/simulator.dir/e64.cpp.o.d"
+  "CMakeFiles/simulator.dir/encoding.cpp.o"
+  "CMakeFiles/simulator.dir/encoding.cpp.o.d"
+  "CMakeFiles/simulator.dir/extracode.cpp.o"
+  "CMakeFiles/simulator.dir/extracode.cpp.o.d"
+  "CMakeFiles/simulator.dir/jit.cpp.o"
+  "CMakeFiles/simulator.dir/jit.cpp.o.d"
+  "CMakeFiles/simulator.dir/machine.cpp.o"
+  "CMakeFiles/simulator.dir/machine.cpp.o.d"
+  "CMakeFiles/simulator.dir/memory.cpp.o"
+  "CMakeFiles/simulator.dir/memory.cpp.o.d"
+  "CMakeFiles/simulator.dir/processor.cpp.o"
+  "CMakeFiles/simulator.dir/processor.cpp.o.d"
+  "CMakeFiles/simulator.dir/session.cpp.o"
+  "CMakeFiles/simulator.dir/session.cpp.o.d"
+  "CMakeFiles/simulator.dir/superblock.cpp.o"
+  "CMakeFiles/simulator.dir/superblock.cpp.o.d"
+  "CMakeFiles/simulator.dir/trace.cpp.o"
+  "CMakeFiles/simulator.dir/trace.cpp.o.d"
+  "libsimulator.a"
+  "libsimulator.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/simulator.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,29 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/tests/alu_test.cpp" "tests/CMakeFiles/unit_tests.dir/alu_test.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/alu_test.cpp.o.d"
+  "/root/repo/tests/cli_test.cpp" "tests/CMakeFiles/unit_tests.dir/cli_test.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/cli_test.cpp.o.d"
+  "/root/repo/tests/cosy_test.cpp" "tests/CMakeFiles/unit_tests.dir/cosy_test.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/cosy_test.cpp.o.d"
+  "/root/repo/tests/cpu_test.cpp" "tests/CMakeFiles/unit_tests.dir/cpu_test.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/cpu_test.cpp.o.d"
+  "/root/repo/tests/e64_test.cpp" "tests/CMakeFiles/unit_tests.dir/e64_test.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/e64_test.cpp.o.d"
+  "/root/repo/tests/machine_test.cpp" "tests/CMakeFiles/unit_tests.dir/machine_test.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/machine_test.cpp.o.d"
+  "/root/repo/tests/session_test.cpp" "tests/CMakeFiles/unit_tests.dir/session_test.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/session_test.cpp.o.d"
+  "/root/repo/tests/util.cpp" "tests/CMakeFiles/unit_tests.dir/util.cpp.o" "gcc" "tests/CMakeFiles/unit_tests.dir/util.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_bench/CMakeFiles/simulator.dir/DependInfo.cmake"
+  "/root/repo/_bench/_deps/googletest-build/googletest/CMakeFiles/gtest.dir/DependInfo.cmake"
+  "/root/repo/_bench/_deps/googletest-build/googletest/CMakeFiles/gtest_main.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,26 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/unit_tests.dir/alu_test.cpp.o"
+  "CMakeFiles/unit_tests.dir/alu_test.cpp.o.d"
+  "CMakeFiles/unit_tests.dir/cli_test.cpp.o"
+  "CMakeFiles/unit_tests.dir/cli_test.cpp.o.d"
+  "CMakeFiles/unit_tests.dir/cosy_test.cpp.o"
+  "CMakeFiles/unit_tests.dir/cosy_test.cpp.o.d"
+  "CMakeFiles/unit_tests.dir/cpu_test.cpp.o"
+  "CMakeFiles/unit_tests.dir/cpu_test.cpp.o.d"
+  "CMakeFiles/unit_tests.dir/e64_test.cpp.o"
+  "CMakeFiles/unit_tests.dir/e64_test.cpp.o.d"
+  "CMakeFiles/unit_tests.dir/machine_test.cpp.o"
+  "CMakeFiles/unit_tests.dir/machine_test.cpp.o.d"
+  "CMakeFiles/unit_tests.dir/session_test.cpp.o"
+  "CMakeFiles/unit_tests.dir/session_test.cpp.o.d"
+  "CMakeFiles/unit_tests.dir/util.cpp.o"
+  "CMakeFiles/unit_tests.dir/util.cpp.o.d"
+  "unit_tests"
+  "unit_tests.pdb"
+  "unit_tests[1]_tests.cmake"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/unit_tests.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
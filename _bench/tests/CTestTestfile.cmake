@@ -0,0 +1,10 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/tests
+# Build directory: /root/repo/_bench/tests
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+include("/root/repo/_bench/tests/unit_tests[1]_include.cmake")
+add_test(jit_engine "/root/repo/_bench/tests/unit_tests" "--gtest_filter=dubna_machine.*:dubna_session.e64_*")
+set_tests_properties(jit_engine PROPERTIES  ENVIRONMENT "DUBNA_ENGINE=jit" TIMEOUT "120" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;53;add_test;/root/repo/tests/CMakeLists.txt;0;")
+subdirs("../_deps/googletest-build")
@@ -0,0 +1,49 @@
+//
+// Superblocks of MS Dubna, translated into C++ ahead of time.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#ifndef DUBNA_AOT_H
+#define DUBNA_AOT_H
+
+#include "jit.h"
+#include "processor.h"
+
+//
+// At build time, aotgen runs MS Dubna from disk image 9, records every
+// superblock it executes, and writes them as C++ functions, with the same
+// semantics as code of the Jit. Both block and jit engines use translated
+// block, but only when memory words still match the recorded hash,
+// see Processor::find_aot().
+// Without translation (DUBNA_AOT=OFF), the table is empty, see aot_none.cpp.
+//
+struct AotBlock {
+    unsigned start;  // PC*2 + right_instr_flag
+    unsigned length; // number of instructions
+    uint64_t hash;   // hash of memory words, see Processor::block_hash()
+    Jit::Code code;  // translated function
+};
+
+// Table of translated blocks, sorted by start.
+extern const AotBlock aot_blocks[];
+extern const unsigned aot_nblocks;
+
+#endif // DUBNA_AOT_H
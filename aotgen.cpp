@@ -0,0 +1,292 @@
+//
+// Translator of MS Dubna superblocks into C++, run at build time.
+// Usage: aotgen output.cpp job.dub...
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "aot.h"
+#include "machine.h"
+
+//
+// Generator of C++ code for superblocks.
+// Semantics is the same as of host code of the Jit.
+//
+class AotWriter {
+private:
+    std::ostream &out;
+
+    // Values of PC and right_instr_flag, known to be in CoreState.
+    unsigned known_pc{};
+    int known_right{};
+
+    void set_pc(unsigned pc, bool right);
+    void jump(const std::string &addr, const char *indent = "    ");
+    bool write_native(const Instruction &ins, unsigned pc, bool right);
+
+public:
+    explicit AotWriter(std::ostream &o) : out(o) {}
+
+    // Write function for the superblock.
+    void write_block(const BlockImage &block, const std::string &name);
+};
+
+//
+// Set PC and right_instr_flag, unless they already have these values.
+//
+void AotWriter::set_pc(unsigned pc, bool right)
+{
+    if (known_pc != pc) {
+        out << "    core.PC = 0" << std::oct << pc << std::dec << ";\n";
+        known_pc = pc;
+    }
+    if (known_right != right) {
+        out << "    core.right_instr_flag = " << (right ? "true" : "false") << ";\n";
+        known_right = right;
+    }
+}
+
+//
+// Jump: PC = addr, right_instr_flag = false.
+//
+void AotWriter::jump(const std::string &addr, const char *indent)
+{
+    out << indent << "core.PC = " << addr << ";\n";
+    out << indent << "core.right_instr_flag = false;\n";
+}
+
+//
+// Write instruction as C++ code, when possible: see Jit::emit_native().
+// PC and right_instr_flag are already advanced past this instruction.
+// Return false when the instruction needs a helper.
+//
+bool AotWriter::write_native(const Instruction &ins, unsigned pc, bool right)
+{
+    std::ostringstream m_reg, addr;
+    m_reg << "core.M[0" << std::oct << unsigned(ins.reg) << "]";
+    addr << "0" << std::oct << ins.addr;
+
+    switch (ins.opcode) {
+    case 0240: // уиа, vtm
+        if (ins.reg) {
+            out << "    " << m_reg.str() << " = " << addr.str() << ";\n";
+        }
+        out << "    core.M[0] = 0;\n";
+        return true;
+
+    case 0250: // слиа, utm
+        if (ins.reg) {
+            out << "    " << m_reg.str() << " = ADDR(" << m_reg.str() << " + " << addr.str()
+                << ");\n";
+        }
+        out << "    core.M[0] = 0;\n";
+        return true;
+
+    case 0300: // пб, uj
+        jump("ADDR(" + m_reg.str() + " + " + addr.str() + ")");
+        return true;
+
+    case 0310: // пв, vjm
+        if (ins.reg) {
+            out << "    " << m_reg.str() << " = 0" << std::oct << (right ? ADDR(pc + 1) : ADDR(pc))
+                << std::dec << ";\n";
+        }
+        out << "    core.M[0] = 0;\n";
+        jump(addr.str());
+        return true;
+
+    case 0340: // пио, vzm
+    case 0360: // э36, *36
+        set_pc(pc, right);
+        out << "    if (!" << m_reg.str() << ") {\n";
+        jump(addr.str(), "        ");
+        out << "    }\n";
+        return true;
+
+    case 0350: // пино, v1m
+        set_pc(pc, right);
+        out << "    if (" << m_reg.str() << ") {\n";
+        jump(addr.str(), "        ");
+        out << "    }\n";
+        return true;
+
+    case 0370: // цикл, vlm
+        set_pc(pc, right);
+        out << "    if (" << m_reg.str() << ") {\n";
+        out << "        " << m_reg.str() << " = ADDR(" << m_reg.str() << " + 1);\n";
+        jump(addr.str(), "        ");
+        out << "    }\n";
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+//
+// Write function for the superblock: see Jit::translate().
+//
+void AotWriter::write_block(const BlockImage &block, const std::string &name)
+{
+    known_pc    = ~0u;
+    known_right = -1;
+
+    out << "\n// Block at 0" << std::oct << block.start / 2 << (block.start & 1 ? " right" : " left")
+        << std::dec << ", length " << block.code.size() << ".\n";
+    out << "static unsigned " << name << "(Processor &cpu, CoreState &core)\n{\n";
+
+    unsigned pc   = block.start / 2;
+    bool right    = block.start & 1;
+    bool modified = false; // address modifier from previous utc/wtc
+    bool jumped   = false; // PC is set by uj or vjm
+    for (unsigned k = 0; k < block.code.size(); k++) {
+        const Instruction &ins = block.code[k];
+
+        // Advance PC past this instruction.
+        if (right) {
+            pc += 1;
+            right = false;
+        } else {
+            right = true;
+        }
+
+        if (!modified && write_native(ins, pc, right)) {
+            jumped = (ins.opcode == 0300 || ins.opcode == 0310);
+        } else {
+            // Direct call of the helper, so that the host compiler can see it.
+            // After the last instruction the block ends anyway.
+            std::ostringstream call;
+            call << "Processor::jit_step<0" << std::oct
+                 << (modified ? unsigned(ins.opcode) : unsigned(ins.entry))
+                 << (modified ? ", true>(cpu, 0" : ", false>(cpu, 0") << unsigned(ins.reg)
+                 << ", 0" << ins.addr << ")";
+            set_pc(pc, right);
+            if (k + 1 < block.code.size()) {
+                out << "    if (" << call.str() << ")\n";
+                out << "        return " << k + 1 << ";\n";
+            } else {
+                out << "    " << call.str() << ";\n";
+            }
+        }
+        modified = (ins.opcode == 0220 || ins.opcode == 0230);
+    }
+    if (!jumped) {
+        // Continue from the next instruction, unless the block has changed PC.
+        set_pc(pc, right);
+    }
+    out << "    return " << block.code.size() << ";\n";
+    out << "}\n";
+}
+
+//
+// Run the job under MS Dubna, and record superblocks.
+//
+static void run_job(const std::string &job_file, std::vector<BlockImage> &log)
+{
+    // Silence output of the job.
+    std::ostringstream job_output;
+    Memory memory;
+    Machine machine(memory);
+    machine.set_output(job_output);
+    machine.cpu.record_blocks(&log);
+    machine.load(job_file);
+
+    // Same setup as in Session.
+    machine.disk_mount(030, "9", false);
+    machine.map_drum_to_disk(021, 030);
+    machine.boot_ms_dubna();
+    machine.run();
+}
+
+//
+// Write C++ source with translated blocks.
+//
+static void write_source(std::ostream &out, std::vector<BlockImage> &log)
+{
+    // Sort by start, and remove duplicates.
+    std::sort(log.begin(), log.end(), [](const BlockImage &a, const BlockImage &b) {
+        if (a.start != b.start)
+            return a.start < b.start;
+        if (a.code.size() != b.code.size())
+            return a.code.size() < b.code.size();
+        return a.hash < b.hash;
+    });
+    log.erase(std::unique(log.begin(), log.end(),
+                          [](const BlockImage &a, const BlockImage &b) {
+                              return a.start == b.start && a.code.size() == b.code.size() &&
+                                     a.hash == b.hash;
+                          }),
+              log.end());
+
+    out << "//\n";
+    out << "// Superblocks of MS Dubna, translated ahead of time.\n";
+    out << "// Generated by aotgen: do not edit.\n";
+    out << "//\n";
+    out << "#include \"aot.h\"\n";
+
+    AotWriter writer(out);
+    for (unsigned i = 0; i < log.size(); i++) {
+        writer.write_block(log[i], "block" + std::to_string(i));
+    }
+
+    out << "\nconst AotBlock aot_blocks[] = {\n";
+    for (unsigned i = 0; i < log.size(); i++) {
+        out << "    { 0" << std::oct << log[i].start << std::dec << ", " << log[i].code.size()
+            << ", 0x" << std::hex << log[i].hash << std::dec << "ull, block" << i << " },\n";
+    }
+    if (log.empty()) {
+        out << "    {},\n";
+    }
+    out << "};\n";
+    out << "const unsigned aot_nblocks = " << log.size() << ";\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " output.cpp job.dub..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BlockImage> log;
+    try {
+        for (int i = 2; i < argc; i++) {
+            run_job(argv[i], log);
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    } catch (...) {
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream out(argv[1]);
+    write_source(out, log);
+    if (!out) {
+        std::cerr << "Cannot write " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
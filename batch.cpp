@@ -0,0 +1,377 @@
+//
+// Class Batch: run many job files in parallel, on a pool of worker threads.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "disk.h"
+#include "session.h"
+
+//
+// How many slowest jobs to show in summary.
+//
+static const unsigned NUM_SLOWEST = 5;
+
+//
+// Queue of job indices, owned by one worker.
+// Other workers steal from the back when idle.
+//
+struct JobQueue {
+    std::mutex mutex;
+    std::deque<unsigned> jobs;
+};
+
+//
+// Get next job for the worker: from the front of its own queue,
+// or from the back of another queue.
+// Return false when all queues are empty.
+//
+static bool next_job(std::vector<JobQueue> &queues, unsigned worker, unsigned &index)
+{
+    for (unsigned i = 0; i < queues.size(); i++) {
+        auto &queue = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.jobs.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            index = queue.jobs.front();
+            queue.jobs.pop_front();
+        } else {
+            index = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+//
+// Instantiate the batch.
+//
+Batch::Batch()
+    : instr_limit(Session::get_default_limit()), disk_cache(std::make_shared<DiskCache>())
+{
+}
+
+Batch::~Batch() = default;
+
+//
+// Add job file, all *.dub files in a directory,
+// or all files listed in a manifest given as @filename.
+//
+void Batch::add_jobs(const std::string &name)
+{
+    namespace fs = std::filesystem;
+
+    if (!name.empty() && name[0] == '@') {
+        // Manifest: one job file per line.
+        // Empty lines and lines starting with # are ignored.
+        std::ifstream manifest(name.substr(1));
+        if (!manifest.is_open())
+            throw std::runtime_error("Cannot read " + name.substr(1));
+
+        std::string line;
+        while (getline(manifest, line)) {
+            if (!line.empty() && line[0] != '#') {
+                add_jobs(line);
+            }
+        }
+        return;
+    }
+
+    if (fs::is_directory(name)) {
+        // All job files in directory, in alphabetical order.
+        std::vector<std::string> files;
+        for (auto &entry : fs::directory_iterator(name)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".dub") {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (auto &file : files) {
+            add_jobs(file);
+        }
+        return;
+    }
+
+    // Output and exit status go next to the job file.
+    Job job;
+    job.file        = name;
+    auto base       = fs::path(name).replace_extension().string();
+    job.output_file = base + ".out";
+    job.status_file = base + ".status";
+    jobs.push_back(job);
+}
+
+//
+// Run jobs on so many threads.
+//
+void Batch::set_workers(unsigned count)
+{
+    if (count == 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_workers = count;
+}
+
+//
+// Select execution engine.
+// Throw exception on unknown name.
+//
+void Batch::set_engine(const std::string &name)
+{
+    Session session;
+    session.set_engine(name);
+    engine = name;
+}
+
+//
+// Watch memory range in every job.
+// Throw exception on bad spec.
+//
+void Batch::add_watchpoint(const std::string &spec)
+{
+    Session session;
+    session.add_watchpoint(spec);
+    watchpoints.push_back(spec);
+}
+
+//
+// Select when writes to disk images are flushed.
+// Throw exception on bad mode.
+//
+void Batch::set_disk_sync(const std::string &mode)
+{
+    Session session;
+    session.set_disk_sync(mode);
+    disk_sync = mode;
+}
+
+//
+// Mount drum or disk in every session.
+//
+void Batch::add_mount(bool disk, unsigned unit, const std::string &filename, bool write_permit)
+{
+    mounts.push_back({ disk, unit, filename, write_permit });
+}
+
+//
+// Keep changes of writable disks in overlay.
+//
+void Batch::enable_disk_overlay(bool commit)
+{
+    disk_overlay        = true;
+    commit_disk_overlay = commit;
+}
+
+//
+// Read disk zones through a cache shared by all jobs.
+//
+void Batch::enable_zone_cache(size_t nbytes)
+{
+    zone_cache = std::make_shared<ZoneCache>(nbytes);
+}
+
+//
+// Run all jobs on a pool of worker threads, print summary.
+//
+int Batch::run(std::ostream &out)
+{
+    // Jobs run at the same time: they cannot write to a shared image.
+    for (auto &mount : mounts) {
+        if (mount.write_permit && !(mount.disk && disk_overlay && !commit_disk_overlay)) {
+            std::cerr << "Error: " << (mount.disk ? "Disk " : "Drum ") << mount.filename
+                      << " cannot be written by all jobs of the batch: use :ro"
+                      << (mount.disk ? ", or --disk-overlay=discard" : "") << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Distribute jobs round robin.
+    unsigned nthreads = std::min<unsigned>(num_workers, jobs.size());
+    std::vector<JobQueue> queues(std::max(1u, nthreads));
+    for (unsigned i = 0; i < jobs.size(); i++) {
+        queues[i % queues.size()].jobs.push_back(i);
+    }
+
+    using namespace std::chrono;
+    auto t0 = steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < nthreads; w++) {
+        workers.emplace_back([this, &queues, w] {
+            unsigned index;
+            while (next_job(queues, w, index)) {
+                run_job(jobs[index]);
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    auto t1 = steady_clock::now();
+    print_summary(out, duration<double>(t1 - t0).count());
+
+    for (auto &job : jobs) {
+        if (job.exit_status != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+//
+// Simulate one job.
+// Write output and exit status into separate files.
+//
+void Batch::run_job(Job &job)
+{
+    std::ofstream output(job.output_file);
+    if (!output.is_open()) {
+        std::cerr << "Cannot write " << job.output_file << std::endl;
+        job.exit_status = EXIT_FAILURE;
+        return;
+    }
+
+    Session session;
+    session.set_output(output);
+    session.set_error_output(output);
+    session.set_disk_cache(disk_cache);
+    if (zone_cache) {
+        session.set_zone_cache(zone_cache);
+    }
+    session.enable_progress_message(false);
+    session.set_limit(instr_limit);
+    session.set_verbose(verbose);
+    if (!engine.empty()) {
+        session.set_engine(engine);
+    }
+    if (!snapshot_file.empty()) {
+        session.start_from_snapshot(snapshot_file);
+    }
+    if (!trace_mode.empty()) {
+        session.enable_trace(trace_mode.c_str());
+    }
+    session.set_job_file(job.file);
+
+    try {
+        for (auto &spec : watchpoints) {
+            session.add_watchpoint(spec);
+        }
+        if (disk_overlay) {
+            session.enable_disk_overlay(commit_disk_overlay);
+        }
+        if (!disk_sync.empty()) {
+            session.set_disk_sync(disk_sync);
+        }
+        for (auto &mount : mounts) {
+            if (mount.disk) {
+                session.disk_mount(mount.unit, mount.filename, mount.write_permit);
+            } else {
+                session.drum_mount(mount.unit, mount.filename, mount.write_permit);
+            }
+        }
+    } catch (const std::exception &ex) {
+        output << "Error: " << ex.what() << std::endl;
+        job.exit_status = EXIT_FAILURE;
+        std::ofstream status(job.status_file);
+        status << job.exit_status << std::endl;
+        return;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    session.run();
+    session.finish();
+    auto t1 = std::chrono::steady_clock::now();
+
+    job.exit_status = session.get_exit_status();
+    job.instr_count = session.get_instr_count();
+    job.sec         = std::chrono::duration<double>(t1 - t0).count();
+
+    std::ofstream status(job.status_file);
+    status << job.exit_status << std::endl;
+}
+
+//
+// Print summary of the batch: throughput, failures and the slowest jobs.
+//
+void Batch::print_summary(std::ostream &out, double sec) const
+{
+    if (sec <= 0)
+        sec = 1e-6;
+
+    uint64_t instr_count = 0;
+    std::vector<const Job *> failed;
+    std::vector<const Job *> slowest;
+    for (auto &job : jobs) {
+        instr_count += job.instr_count;
+        if (job.exit_status != EXIT_SUCCESS) {
+            failed.push_back(&job);
+        }
+        slowest.push_back(&job);
+    }
+    std::sort(slowest.begin(), slowest.end(),
+              [](const Job *a, const Job *b) { return a->sec > b->sec; });
+    if (slowest.size() > NUM_SLOWEST) {
+        slowest.resize(NUM_SLOWEST);
+    }
+
+    auto save_flags    = out.flags();
+    int time_precision = (sec < 1) ? 3 : (sec < 10) ? 2 : 1;
+    unsigned nthreads  = std::min<unsigned>(num_workers, jobs.size());
+
+    out << "------------------------------------------------------------" << std::endl;
+    out << "           Jobs: " << jobs.size() << " on " << nthreads << " threads" << std::endl;
+    out << "   Elapsed time: " << std::fixed << std::setprecision(time_precision) << sec
+        << " seconds" << std::endl;
+    out << "      Simulated: " << instr_count << " instructions" << std::endl;
+    out << "     Throughput: " << std::setprecision(1) << jobs.size() / sec << " jobs/sec, "
+        << std::lround(instr_count / sec) << " instructions/sec" << std::endl;
+    if (zone_cache) {
+        auto stats = zone_cache->get_stats();
+        out << "     Zone cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+            << stats.evictions << " evictions" << std::endl;
+    }
+    out << "         Failed: " << failed.size() << " jobs" << std::endl;
+    for (auto *job : failed) {
+        out << "                 " << job->file << std::endl;
+    }
+    out << "   Slowest jobs:" << std::endl;
+    for (auto *job : slowest) {
+        out << "                 " << std::setprecision(3) << job->sec << " sec  " << job->file
+            << std::endl;
+    }
+    out.flags(save_flags);
+}
@@ -0,0 +1,119 @@
+//
+// Class Batch: run many job files in parallel, on a pool of worker threads.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#ifndef DUBNA_BATCH_H
+#define DUBNA_BATCH_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+class DiskCache;
+class ZoneCache;
+
+class Batch {
+private:
+    // One job of the batch.
+    struct Job {
+        std::string file;        // job file in MS Dubna format
+        std::string output_file; // output of the job
+        std::string status_file; // exit status of the job
+        int exit_status{ -1 };
+        uint64_t instr_count{};
+        double sec{};
+    };
+    std::vector<Job> jobs;
+
+    // Parameters for every session.
+    unsigned num_workers{ 1 };
+    std::string engine;
+    uint64_t instr_limit;
+    bool verbose{};
+    std::string snapshot_file;
+    std::string trace_mode;
+    std::vector<std::string> watchpoints;
+    bool disk_overlay{};
+    bool commit_disk_overlay{};
+    std::string disk_sync;
+
+    // Drums and disks mounted by every session.
+    struct Mount {
+        bool disk;
+        unsigned unit;
+        std::string filename;
+        bool write_permit;
+    };
+    std::vector<Mount> mounts;
+
+    // Disk images, opened once for all jobs.
+    std::shared_ptr<DiskCache> disk_cache;
+
+    // Zone records of disk images, shared by all jobs, when enabled.
+    std::shared_ptr<ZoneCache> zone_cache;
+
+    // Simulate one job.
+    void run_job(Job &job);
+
+    // Print summary of the batch.
+    void print_summary(std::ostream &out, double sec) const;
+
+public:
+    // Constructor.
+    Batch();
+
+    // Destructor.
+    ~Batch();
+
+    // Add job file, all *.dub files in a directory,
+    // or all files listed in a manifest given as @filename.
+    void add_jobs(const std::string &name);
+    unsigned get_job_count() const { return jobs.size(); }
+
+    // Run jobs on so many threads. Zero means one per host CPU.
+    void set_workers(unsigned count);
+
+    // Parameters of the session, same as in Session.
+    void set_engine(const std::string &name);
+    void set_limit(uint64_t count) { instr_limit = count; }
+    void set_verbose(bool on = true) { verbose = on; }
+    void start_from_snapshot(const std::string &filename) { snapshot_file = filename; }
+    void enable_trace(const char *mode) { trace_mode = mode; }
+    void add_watchpoint(const std::string &spec);
+    void set_disk_sync(const std::string &mode);
+
+    // Mount drum or disk in every session. Jobs run at the same time,
+    // so writable disk needs overlay, with changes discarded.
+    void add_mount(bool disk, unsigned unit, const std::string &filename, bool write_permit);
+    void enable_disk_overlay(bool commit);
+
+    // Read disk zones through a cache of the given size in bytes, shared by all jobs.
+    void enable_zone_cache(size_t nbytes);
+
+    // Run all jobs, print summary.
+    // Return EXIT_SUCCESS when all jobs succeeded.
+    int run(std::ostream &out);
+};
+
+#endif // DUBNA_BATCH_H
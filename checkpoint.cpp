@@ -0,0 +1,158 @@
+//
+// Incremental checkpoints of the machine state in memory, with rollback.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <algorithm>
+#include <sstream>
+
+#include "machine.h"
+
+// Drum zone not allocated.
+static const auto zero_page = std::make_shared<const std::array<Word, PAGE_NWORDS>>();
+
+//
+// Enable checkpoints: take one every so many instructions,
+// and keep the given number of most recent ones.
+// Zero interval disables checkpoints and drops all of them.
+//
+void Machine::enable_checkpoints(uint64_t interval, unsigned retain)
+{
+    if (interval != 0 && retain == 0)
+        throw std::runtime_error("Need to retain at least one checkpoint");
+
+    checkpoint_interval = interval;
+    checkpoint_retain   = retain;
+    next_checkpoint     = simulated_instructions;
+    checkpoints.clear();
+}
+
+//
+// Get instruction count at the checkpoint.
+//
+uint64_t Machine::get_checkpoint_instr_count(unsigned index) const
+{
+    if (index >= checkpoints.size())
+        throw std::runtime_error("No checkpoint #" + std::to_string(index));
+
+    return checkpoints[index].instr_count;
+}
+
+//
+// Save state of the machine as a new checkpoint.
+// Only pages and zones modified since the previous checkpoint are copied,
+// the rest is shared with it. Drop the oldest checkpoints above the limit.
+//
+void Machine::take_checkpoint()
+{
+    const Checkpoint *prev = checkpoints.empty() ? nullptr : &checkpoints.back();
+    Checkpoint cp;
+
+    cp.instr_count = simulated_instructions;
+    std::ostringstream state;
+    cpu.save_state(state);
+    cp.cpu_state = state.str();
+
+    // Memory pages.
+    for (unsigned page = 0; page < cp.pages.size(); page++) {
+        if (prev && !memory.is_page_dirty(page)) {
+            cp.pages[page] = prev->pages[page];
+        } else {
+            auto copy = std::make_shared<Page>();
+            std::copy_n(memory.get_ptr(page * PAGE_NWORDS), PAGE_NWORDS, copy->begin());
+            cp.pages[page] = std::move(copy);
+        }
+    }
+    memory.clear_dirty_pages();
+
+    // Drum zones. Absent drums have no zones.
+    // Zones not allocated share one page of zeros.
+    for (unsigned i = 0; i < NDRUMS; i++) {
+        if (!drums[i])
+            continue;
+
+        uint32_t dirty = drums[i]->get_dirty_zones();
+        for (unsigned zone = 0; zone < Drum::NZONES; zone++) {
+            if (!drums[i]->is_zone_allocated(zone)) {
+                cp.zones[i][zone] = zero_page;
+            } else if (prev && prev->zones[i][zone] && !((dirty >> zone) & 1)) {
+                cp.zones[i][zone] = prev->zones[i][zone];
+            } else {
+                auto copy = std::make_shared<Page>();
+                std::copy_n(drums[i]->get_zone(zone), PAGE_NWORDS, copy->begin());
+                cp.zones[i][zone] = std::move(copy);
+            }
+        }
+        drums[i]->clear_dirty_zones();
+    }
+
+    checkpoints.push_back(std::move(cp));
+    while (checkpoints.size() > checkpoint_retain) {
+        checkpoints.pop_front();
+    }
+    next_checkpoint = simulated_instructions + checkpoint_interval;
+}
+
+//
+// Restore state of the machine from the checkpoint.
+// Later checkpoints are dropped: new ones will be taken when run() continues.
+// Printer output, and writes to disks, are not undone.
+//
+void Machine::rollback(unsigned index)
+{
+    if (index >= checkpoints.size())
+        throw std::runtime_error("No checkpoint #" + std::to_string(index));
+
+    const Checkpoint &cp = checkpoints[index];
+
+    // Memory pages.
+    for (unsigned page = 0; page < cp.pages.size(); page++) {
+        std::copy(cp.pages[page]->begin(), cp.pages[page]->end(),
+                  memory.get_ptr(page * PAGE_NWORDS));
+    }
+    memory.clear_dirty_pages();
+    cpu.invalidate(0, MEMORY_NWORDS);
+
+    // Drum zones. Drums allocated after the checkpoint are removed.
+    for (unsigned i = 0; i < NDRUMS; i++) {
+        if (!cp.zones[i][0]) {
+            drums[i].reset();
+            continue;
+        }
+        drum_init(i);
+        for (unsigned zone = 0; zone < Drum::NZONES; zone++) {
+            if (cp.zones[i][zone] == zero_page) {
+                drums[i]->clear_zone(zone);
+            } else {
+                drums[i]->write_zone(zone, cp.zones[i][zone]->data());
+            }
+        }
+        drums[i]->clear_dirty_zones();
+    }
+
+    std::istringstream state(cp.cpu_state);
+    cpu.restore_state(state);
+    simulated_instructions = cp.instr_count;
+    progress_count         = cp.instr_count;
+
+    checkpoints.erase(checkpoints.begin() + index + 1, checkpoints.end());
+    next_checkpoint = simulated_instructions + checkpoint_interval;
+}
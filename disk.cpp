@@ -22,17 +22,21 @@
 // SOFTWARE.
 //
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 #include "machine.h"
 
 //
-// Open binary image as disk.
+// Open binary image.
 //
-Disk::Disk(Memory &m, const std::string &p, bool wp) : memory(m), path(p), write_permit(wp)
+DiskImage::DiskImage(const std::string &p, bool wp, bool use_mapping) : path(p), write_permit(wp)
 {
     // Open file.
     int open_flag   = write_permit ? O_RDWR : O_RDONLY;
@@ -44,19 +48,47 @@ Disk::Disk(Memory &m, const std::string &p, bool wp) : memory(m), path(p), write
     // Get file size.
     struct stat stat;
     fstat(file_descriptor, &stat);
+    file_size = stat.st_size;
     num_zones = stat.st_size / DISK_ZONE_NWORDS;
+    device    = stat.st_dev;
+    inode     = stat.st_ino;
+
+    // Map the whole file. Page cache is shared by all processes using the image.
+    if (use_mapping && file_size > 0) {
+        void *ptr = mmap(nullptr, file_size, write_permit ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                         MAP_SHARED, file_descriptor, 0);
+        if (ptr != MAP_FAILED) {
+            mapping = static_cast<char *>(ptr);
+        }
+    }
 }
 
-// Close file in destructor.
-Disk::~Disk()
+// Stop writer, unmap and close file in destructor.
+// Write errors are reported by drain(), before the image is closed.
+DiskImage::~DiskImage()
 {
+    if (writer.joinable()) {
+        // Writer thread completes the queue before exit.
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            writer_stop = true;
+        }
+        queue_changed.notify_all();
+        writer.join();
+    }
+    if (mapping) {
+        if (write_permit) {
+            msync(mapping, file_size, MS_SYNC);
+        }
+        munmap(mapping, file_size);
+    }
     close(file_descriptor);
 }
 
 //
-// Disk read: transfer data to memory.
+// Get offset of the sector in the file.
 //
-void Disk::disk_to_memory(unsigned zone, unsigned sector, unsigned addr, unsigned nwords)
+off_t DiskImage::sector_offset(unsigned zone, unsigned sector) const
 {
     zone += DISK_ZONE_OFFSET;
     if (zone >= num_zones)
@@ -65,37 +97,490 @@ void Disk::disk_to_memory(unsigned zone, unsigned sector, unsigned addr, unsigne
     unsigned offset_nwords = (DISK_ZONE_NWORDS * zone) + // start of the zone record
                              8 +                         // skip OS info
                              (256 * sector);             // sector offset
+    return (off_t)offset_nwords * sizeof(Word);
+}
+
+//
+// Read data from the image.
+//
+void DiskImage::read(unsigned zone, unsigned sector, Word *destination, unsigned nwords) const
+{
+    read_at(sector_offset(zone, sector), destination, nwords);
+}
 
-    if (lseek(file_descriptor, offset_nwords * sizeof(Word), SEEK_SET) < 0)
-        throw std::runtime_error("Disk seek error");
+void DiskImage::read_at(off_t offset, Word *destination, unsigned nwords) const
+{
+    unsigned nbytes = nwords * sizeof(Word);
+    if (mapping) {
+        if ((size_t)offset + nbytes > file_size)
+            throw std::runtime_error("Disk read error");
+        std::memcpy(destination, mapping + offset, nbytes);
+        return;
+    }
 
-    Word *destination = memory.get_ptr(addr);
-    unsigned nbytes   = nwords * sizeof(Word);
-    if (read(file_descriptor, destination, nbytes) != nbytes)
+    // Data still in the write queue are newer than the file.
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (pread(file_descriptor, destination, nbytes, offset) != nbytes)
         throw std::runtime_error("Disk read error");
+    for (auto &request : write_queue) {
+        off_t start = std::max(offset, request.offset);
+        off_t end   = std::min<off_t>(offset + nbytes,
+                                      request.offset + request.data.size() * sizeof(Word));
+        if (start < end) {
+            std::memcpy((char *)destination + (start - offset),
+                        (const char *)request.data.data() + (start - request.offset),
+                        end - start);
+        }
+    }
 }
 
 //
-// Disk write: transfer data from memory.
+// Write data to the image.
 //
-void Disk::memory_to_disk(unsigned zone, unsigned sector, unsigned addr, unsigned nwords)
+void DiskImage::write(unsigned zone, unsigned sector, const Word *source, unsigned nwords)
+{
+    write_at(sector_offset(zone, sector), source, nwords);
+}
+
+void DiskImage::write_at(off_t offset, const Word *source, unsigned nwords)
 {
     if (!write_permit)
         throw std::runtime_error("Cannot write to read-only disk");
 
-    zone += DISK_ZONE_OFFSET;
-    if (zone >= num_zones)
-        throw std::runtime_error("Zone number exceeds disk size");
+    unsigned nbytes = nwords * sizeof(Word);
+    if (mapping) {
+        if ((size_t)offset + nbytes > file_size)
+            throw std::runtime_error("Disk write error");
+        std::memcpy(mapping + offset, source, nbytes);
+        return;
+    }
+    enqueue({ offset, std::vector<Word>(source, source + nwords), 0 });
+}
 
-    unsigned offset_nwords = (DISK_ZONE_NWORDS * zone) + // start of the zone record
-                             8 +                         // skip OS info
-                             (256 * sector);             // sector offset
+//
+// Put request into the write queue.
+// Start the writer thread on first request.
+// Report an error of previous writes, if any.
+//
+void DiskImage::enqueue(PendingWrite &&request)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if (write_error) {
+        write_error = false;
+        throw std::runtime_error("Disk write error: " + path);
+    }
+    if (!writer.joinable()) {
+        writer = std::thread(&DiskImage::write_back, this);
+    }
 
-    if (lseek(file_descriptor, offset_nwords * sizeof(Word), SEEK_SET) < 0)
-        throw std::runtime_error("Disk seek error");
+    // Don't let the queue grow without limit.
+    queue_changed.wait(lock, [this] { return write_queue.size() < WRITE_QUEUE_MAX; });
+    write_queue.push_back(std::move(request));
+    queue_changed.notify_all();
+}
 
-    Word *source    = memory.get_ptr(addr);
-    unsigned nbytes = nwords * sizeof(Word);
-    if (write(file_descriptor, source, nbytes) != nbytes)
-        throw std::runtime_error("Disk write error");
+//
+// Writer thread: perform queued requests in order, until stopped.
+// Request stays in the queue while it is being written,
+// so that readers take data from it.
+//
+void DiskImage::write_back()
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    for (;;) {
+        queue_changed.wait(lock, [this] { return writer_stop || !write_queue.empty(); });
+        if (write_queue.empty()) {
+            // Stopped, and all done.
+            return;
+        }
+        auto &request = write_queue.front();
+        lock.unlock();
+
+        bool ok;
+        if (request.data.empty()) {
+            ok = sync_file_range(file_descriptor, request.offset, request.sync_nbytes,
+                                 SYNC_FILE_RANGE_WRITE) == 0;
+        } else {
+            unsigned nbytes = request.data.size() * sizeof(Word);
+            ok = pwrite(file_descriptor, request.data.data(), nbytes, request.offset) == nbytes;
+        }
+
+        lock.lock();
+        if (!ok) {
+            write_error = true;
+        }
+        write_queue.pop_front();
+        queue_changed.notify_all();
+    }
+}
+
+//
+// Wait until queued writes reach the file.
+//
+void DiskImage::drain() const
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_changed.wait(lock, [this] { return write_queue.empty(); });
+    if (write_error) {
+        write_error = false;
+        throw std::runtime_error("Disk write error: " + path);
+    }
+}
+
+//
+// Flush written data in the range to storage.
+// Without wait, the kernel is asked to start the write-back,
+// and for unmapped file the request is queued after pending writes.
+//
+void DiskImage::sync(off_t offset, size_t nbytes, bool wait)
+{
+    if (!write_permit || nbytes == 0)
+        return;
+
+    if (mapping) {
+        // Address must be aligned to page boundary.
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t start                  = offset & ~(page_size - 1);
+        msync(mapping + start, offset + nbytes - start, wait ? MS_SYNC : MS_ASYNC);
+    } else if (wait) {
+        drain();
+        fdatasync(file_descriptor);
+    } else {
+        enqueue({ offset, {}, nbytes });
+    }
+}
+
+//
+// Ask the kernel to read the zone record in background,
+// so that the following read does not wait for the storage.
+//
+bool DiskImage::prefetch(unsigned record) const
+{
+    off_t offset  = (off_t)record * DISK_ZONE_NWORDS * sizeof(Word);
+    size_t nbytes = DISK_ZONE_NWORDS * sizeof(Word);
+    if ((size_t)offset + nbytes > file_size)
+        return false;
+
+    if (mapping) {
+        // Address must be aligned to page boundary.
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t start                  = offset & ~(page_size - 1);
+        madvise(mapping + start, offset + nbytes - start, MADV_WILLNEED);
+    } else {
+        posix_fadvise(file_descriptor, offset, nbytes, POSIX_FADV_WILLNEED);
+    }
+    return true;
+}
+
+//
+// Get FNV-1a hash of the file contents, by words.
+// Computed once: the image is not expected to change behind our back.
+//
+uint64_t DiskImage::get_hash() const
+{
+    std::call_once(hash_done, [this] {
+        drain();
+        uint64_t h = 0xcbf29ce484222325;
+        std::vector<Word> buf(DISK_ZONE_NWORDS);
+        off_t offset = 0;
+        for (;;) {
+            auto nbytes = pread(file_descriptor, buf.data(), buf.size() * sizeof(Word), offset);
+            if (nbytes <= 0)
+                break;
+            offset += nbytes;
+
+            // Partial word at the end of file is padded with zeros.
+            unsigned nwords = (nbytes + sizeof(Word) - 1) / sizeof(Word);
+            std::fill((char *)buf.data() + nbytes, (char *)(buf.data() + nwords), 0);
+            for (unsigned i = 0; i < nwords; i++) {
+                h ^= buf[i];
+                h *= 0x100000001b3;
+            }
+        }
+        hash = h;
+    });
+    return hash;
+}
+
+//
+// Get read-only image by path.
+// Open it on first request.
+//
+std::shared_ptr<DiskImage> DiskCache::open(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto &image = images[path];
+    if (!image) {
+        image = std::make_shared<DiskImage>(path, false);
+    }
+    return image;
+}
+
+//
+// Get zone record of the image from cache.
+// On miss, the record is read without holding the lock:
+// concurrent readers of the same record may both read it.
+// When the record is invalidated meanwhile, the data may be stale:
+// they are returned to the caller, but not cached.
+//
+ZoneCache::Record ZoneCache::get(const DiskImage &image, unsigned record, Stats &caller_stats)
+{
+    Key key(image.get_device(), image.get_inode(), record);
+    uint64_t generation0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            stats.hits++;
+            caller_stats.hits++;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+        stats.misses++;
+        caller_stats.misses++;
+        generation0 = generation;
+    }
+
+    auto data = std::make_shared<std::vector<Word>>(DISK_ZONE_NWORDS);
+    image.read_at((off_t)record * DISK_ZONE_NWORDS * sizeof(Word), data->data(),
+                  DISK_ZONE_NWORDS);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (generation == generation0 && index.find(key) == index.end()) {
+        lru.emplace_front(key, data);
+        index[key] = lru.begin();
+        used_bytes += DISK_ZONE_NWORDS * sizeof(Word);
+
+        // Evict least recently used records, but keep the new one.
+        while (used_bytes > budget_bytes && lru.size() > 1) {
+            index.erase(lru.back().first);
+            lru.pop_back();
+            used_bytes -= DISK_ZONE_NWORDS * sizeof(Word);
+            stats.evictions++;
+            caller_stats.evictions++;
+        }
+    }
+    return data;
+}
+
+//
+// Forget cached record of the image.
+//
+void ZoneCache::invalidate(const DiskImage &image, unsigned record)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    generation++;
+    auto it = index.find(Key(image.get_device(), image.get_inode(), record));
+    if (it != index.end()) {
+        lru.erase(it->second);
+        index.erase(it);
+        used_bytes -= DISK_ZONE_NWORDS * sizeof(Word);
+    }
+}
+
+//
+// Get statistics of the whole cache.
+//
+ZoneCache::Stats ZoneCache::get_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+//
+// Open binary image as disk.
+//
+Disk::Disk(Memory &m, const std::string &path, bool write_permit)
+    : memory(m), image(std::make_shared<DiskImage>(path, write_permit))
+{
+}
+
+//
+// Use an image opened elsewhere.
+// With overlay, the image is not modified: changed zones are kept in memory.
+//
+Disk::Disk(Memory &m, std::shared_ptr<DiskImage> i, bool with_overlay)
+    : memory(m), image(std::move(i)), overlay_enabled(with_overlay)
+{
+}
+
+//
+// Disk read: transfer data to memory.
+//
+void Disk::disk_to_memory(unsigned zone, unsigned sector, unsigned addr, unsigned nwords)
+{
+    // Writable image bypasses the cache.
+    bool use_cache    = zone_cache && !image->is_writable();
+    off_t offset      = image->sector_offset(zone, sector) / sizeof(Word);
+    Word *destination = memory.get_ptr(addr);
+    if (overlay.empty() && !use_cache) {
+        image->read_at(offset * sizeof(Word), destination, nwords);
+        for_each_record(offset, nwords,
+                        [&](unsigned record, unsigned, unsigned) { prefetch(record); });
+    } else {
+        // Zones present in overlay are taken from it, the rest from the cache or the image.
+        // Read-ahead follows only the reads from the image.
+        for_each_record(offset, nwords, [&](unsigned record, unsigned start, unsigned count) {
+            auto it = overlay.find(record);
+            if (it != overlay.end()) {
+                std::copy_n(&it->second[start], count, destination);
+            } else if (use_cache) {
+                auto misses = zone_cache_stats.misses;
+                auto data   = zone_cache->get(*image, record, zone_cache_stats);
+                std::copy_n(&(*data)[start], count, destination);
+                if (zone_cache_stats.misses != misses) {
+                    prefetch(record);
+                }
+            } else {
+                image->read_at(((off_t)record * DISK_ZONE_NWORDS + start) * sizeof(Word),
+                               destination, count);
+                prefetch(record);
+            }
+            destination += count;
+        });
+    }
+    memory.mark_dirty(addr, nwords);
+}
+
+//
+// Sequential read-ahead, called after the zone record was read from the image.
+// When records are read in order, request the next few records in advance,
+// unless they are kept in overlay.
+// Any other access pattern forgets the pending requests.
+//
+void Disk::prefetch(unsigned record)
+{
+    if (prefetched.erase(record)) {
+        prefetch_hits++;
+    }
+    if (record == last_read_record) {
+        // Next sector of the same zone.
+        return;
+    }
+    bool sequential  = (record == last_read_record + 1);
+    last_read_record = record;
+    if (!sequential) {
+        prefetched.clear();
+        return;
+    }
+    for (unsigned r = record + 1; r <= record + PREFETCH_NZONES; r++) {
+        if (!prefetched.count(r) && !overlay.count(r) && image->prefetch(r)) {
+            prefetched.insert(r);
+            prefetch_count++;
+        }
+    }
+}
+
+//
+// Disk write: transfer data from memory.
+//
+void Disk::memory_to_disk(unsigned zone, unsigned sector, unsigned addr, unsigned nwords)
+{
+    if (!overlay_enabled) {
+        off_t offset = image->sector_offset(zone, sector);
+        off_t end    = offset + nwords * sizeof(Word);
+        image->write_at(offset, memory.get_ptr(addr), nwords);
+        if (zone_cache) {
+            // Other machines may read this image through the cache:
+            // data must reach the file first.
+            image->drain();
+            for_each_record(offset / sizeof(Word), nwords,
+                            [&](unsigned record, unsigned, unsigned) {
+                                zone_cache->invalidate(*image, record);
+                            });
+        }
+        if (sync_policy == DiskSync::NONE) {
+            return;
+        }
+
+        // Start flushing the range written since the last flush.
+        dirty_begin = unsynced_writes ? std::min(dirty_begin, offset) : offset;
+        dirty_end   = unsynced_writes ? std::max(dirty_end, end) : end;
+        unflushed   = true;
+        unsynced_writes++;
+        if (sync_policy == DiskSync::EVERY_N && unsynced_writes >= sync_interval) {
+            image->sync(dirty_begin, dirty_end - dirty_begin, false);
+            unsynced_writes = 0;
+            sync_count++;
+        }
+        return;
+    }
+
+    // Copy zone records to overlay on first write.
+    off_t offset       = image->sector_offset(zone, sector) / sizeof(Word);
+    const Word *source = memory.get_ptr(addr);
+    for_each_record(offset, nwords, [&](unsigned record, unsigned start, unsigned count) {
+        auto &data = overlay[record];
+        if (data.empty()) {
+            data.resize(DISK_ZONE_NWORDS);
+            image->read_at((off_t)record * DISK_ZONE_NWORDS * sizeof(Word), data.data(),
+                           DISK_ZONE_NWORDS);
+        }
+        std::copy_n(source, count, &data[start]);
+        source += count;
+    });
+}
+
+//
+// Select when writes are flushed to storage.
+//
+void Disk::set_sync_policy(DiskSync policy, unsigned interval)
+{
+    sync_policy   = policy;
+    sync_interval = interval;
+}
+
+//
+// At the end of job: wait for queued writes, and flush them to storage.
+//
+void Disk::sync()
+{
+    image->drain();
+    if (sync_policy == DiskSync::NONE || !unflushed) {
+        return;
+    }
+    image->sync(0, image->get_file_size(), true);
+    unsynced_writes = 0;
+    unflushed       = false;
+    sync_count++;
+}
+
+//
+// Split transfer at the given word offset in the image into pieces by zone records.
+//
+template <typename Func>
+void Disk::for_each_record(off_t offset, unsigned nwords, Func func)
+{
+    while (nwords > 0) {
+        unsigned record = offset / DISK_ZONE_NWORDS;
+        unsigned start  = offset % DISK_ZONE_NWORDS;
+        unsigned count  = std::min(nwords, DISK_ZONE_NWORDS - start);
+
+        func(record, start, count);
+        offset += count;
+        nwords -= count;
+    }
+}
+
+//
+// Write zones from overlay to the image, and clear the overlay.
+//
+void Disk::commit_overlay()
+{
+    if (overlay.empty()) {
+        return;
+    }
+    DiskImage target(image->get_path(), true);
+    for (auto &[record, data] : overlay) {
+        target.write_at((off_t)record * DISK_ZONE_NWORDS * sizeof(Word), data.data(),
+                        DISK_ZONE_NWORDS);
+        if (zone_cache) {
+            zone_cache->invalidate(*image, record);
+        }
+    }
+    target.drain();
+    overlay.clear();
 }
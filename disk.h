@@ -24,25 +24,260 @@
 #ifndef DUBNA_DISK_H
 #define DUBNA_DISK_H
 
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <vector>
+
 #include "memory.h"
 
-class Disk {
+//
+// Binary image of a disk, opened once.
+// Read-only image can be shared by several machines.
+// The whole file is mapped into memory, and data are copied to or from
+// the mapping. When the file cannot be mapped, data are transferred
+// by pread/pwrite, with no common file position: writes are queued
+// and done by background thread, in order.
+//
+class DiskImage {
 private:
-    // Reference to the BESM-6 memory.
-    Memory &memory;
-
     // File path.
     std::string path;
     bool write_permit;
     int file_descriptor;
     unsigned num_zones;
 
+    // Identity of the file, whatever path is used to open it.
+    dev_t device{};
+    ino_t inode{};
+
+    // Contents of the file, when mapped.
+    char *mapping{};
+    size_t file_size{};
+
+    // Write-back queue, when the file is not mapped.
+    // Entry without data is a request to start write-back of the range to storage.
+    struct PendingWrite {
+        off_t offset;
+        std::vector<Word> data;
+        size_t sync_nbytes;
+    };
+    static const unsigned WRITE_QUEUE_MAX = 256;
+    mutable std::mutex queue_mutex;
+    mutable std::condition_variable queue_changed;
+    std::deque<PendingWrite> write_queue;
+    std::thread writer;
+    bool writer_stop{};
+    mutable bool write_error{};
+
+    // Body of the writer thread.
+    void write_back();
+    void enqueue(PendingWrite &&request);
+
+    // Hash of file contents, computed on first request.
+    mutable std::once_flag hash_done;
+    mutable uint64_t hash{};
+
+public:
+    // Offset of the sector in the file, in bytes.
+    // Throw exception when zone is beyond the end of file.
+    off_t sector_offset(unsigned zone, unsigned sector) const;
+
+    // Constructor throws exception if the file cannot be opened.
+    // Without mapping, data are transferred by pread/pwrite.
+    explicit DiskImage(const std::string &path, bool write_permit, bool use_mapping = true);
+
+    // Stop writer, unmap and close file in destructor.
+    ~DiskImage();
+
+    // Delete copy/move constructors.
+    DiskImage(const DiskImage &)            = delete;
+    DiskImage &operator=(const DiskImage &) = delete;
+
+    const std::string &get_path() const { return path; }
+    bool is_writable() const { return write_permit; }
+    bool is_mapped() const { return mapping != nullptr; }
+    size_t get_file_size() const { return file_size; }
+    dev_t get_device() const { return device; }
+    ino_t get_inode() const { return inode; }
+
+    // Get hash of the file contents.
+    uint64_t get_hash() const;
+
+    // Data transfer.
+    void read(unsigned zone, unsigned sector, Word *destination, unsigned nwords) const;
+    void write(unsigned zone, unsigned sector, const Word *source, unsigned nwords);
+
+    // Data transfer at offset in the file, in bytes.
+    void read_at(off_t offset, Word *destination, unsigned nwords) const;
+    void write_at(off_t offset, const Word *source, unsigned nwords);
+
+    // Wait until queued writes reach the file.
+    // Throw exception when any of them failed.
+    void drain() const;
+
+    // Flush written data in the range to storage.
+    // Without wait, only start the write-back.
+    void sync(off_t offset, size_t nbytes, bool wait);
+
+    // Ask the kernel to read the zone record in background.
+    // Return false when record is beyond the end of file.
+    bool prefetch(unsigned record) const;
+};
+
+//
+// Read-only disk images, opened on first request
+// and shared by all sessions in the process.
+//
+class DiskCache {
+private:
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<DiskImage>> images;
+
+public:
+    // Get image by path, open when needed.
+    std::shared_ptr<DiskImage> open(const std::string &path);
+};
+
+//
+// Zone records of disk images, shared by all sessions in the process.
+// Keyed by identity of the image file and physical zone number in the file.
+// Least recently used records are evicted when the budget is exceeded.
+//
+class ZoneCache {
+public:
+    using Record = std::shared_ptr<const std::vector<Word>>;
+
+    // Statistics, for the whole cache or for one user of it.
+    struct Stats {
+        uint64_t hits{};
+        uint64_t misses{};
+        uint64_t evictions{};
+    };
+
+private:
+    using Key = std::tuple<dev_t, ino_t, unsigned>;
+
+    std::mutex mutex;
+    size_t budget_bytes;
+    size_t used_bytes{};
+
+    // Records in order of use, most recent first.
+    std::list<std::pair<Key, Record>> lru;
+    std::map<Key, decltype(lru)::iterator> index;
+
+    // Incremented by every invalidate(): record read before that is not cached.
+    uint64_t generation{};
+
+    Stats stats;
+
+public:
+    explicit ZoneCache(size_t nbytes) : budget_bytes(nbytes) {}
+
+    // Get zone record of the image, read it when missing.
+    // Add hit or miss and evictions to the statistics of the caller.
+    Record get(const DiskImage &image, unsigned record, Stats &caller_stats);
+
+    // Forget the record after write to the image.
+    void invalidate(const DiskImage &image, unsigned record);
+
+    // Statistics of the whole cache.
+    Stats get_stats();
+};
+
+//
+// When writes to disk images are flushed to storage.
+// Written data are visible to readers at once in any case.
+//
+enum class DiskSync {
+    NONE,    // left to the kernel, and when the image is closed
+    JOB_END, // at the end of job
+    EVERY_N, // started every so many write transfers, and completed at the end of job
+};
+
+class Disk {
+private:
+    // Reference to the BESM-6 memory.
+    Memory &memory;
+
+    // Image file, probably shared with other machines.
+    std::shared_ptr<DiskImage> image;
+
+    // Zone records modified by this machine, over the read-only image:
+    // indexed by physical zone number in the file.
+    bool overlay_enabled{};
+    std::map<unsigned, std::vector<Word>> overlay;
+
+    // Zone records shared with other machines, when present.
+    std::shared_ptr<ZoneCache> zone_cache;
+    ZoneCache::Stats zone_cache_stats;
+
+    // Sequential read-ahead: zone records requested from the kernel,
+    // but not read from the image yet.
+    static const unsigned PREFETCH_NZONES = 4;
+    unsigned last_read_record{ ~0u };
+    std::set<unsigned> prefetched;
+    uint64_t prefetch_count{};
+    uint64_t prefetch_hits{};
+
+    void prefetch(unsigned record);
+
+    // Flush policy for writes to the image.
+    DiskSync sync_policy{ DiskSync::NONE };
+    unsigned sync_interval{};
+
+    // Writes since the last flush was started, and range of the image they cover, in bytes.
+    unsigned unsynced_writes{};
+    off_t dirty_begin{};
+    off_t dirty_end{};
+
+    // Writes not flushed to storage yet.
+    bool unflushed{};
+    uint64_t sync_count{};
+
+    template <typename Func>
+    static void for_each_record(off_t offset, unsigned nwords, Func func);
+
 public:
     // Constructor throws exception if the file cannot be opened.
     explicit Disk(Memory &memory, const std::string &path, bool write_permit);
 
-    // Close file in destructor.
-    ~Disk();
+    // Use an image opened elsewhere, optionally with overlay for writes.
+    explicit Disk(Memory &m, std::shared_ptr<DiskImage> i, bool with_overlay = false);
+
+    const std::string &get_path() const { return image->get_path(); }
+    bool is_writable() const { return overlay_enabled || image->is_writable(); }
+    uint64_t get_hash() const { return image->get_hash(); }
+
+    // Read zones through the shared cache.
+    // Writes to the image invalidate cached zones.
+    void set_zone_cache(std::shared_ptr<ZoneCache> cache) { zone_cache = std::move(cache); }
+    const ZoneCache::Stats &get_zone_cache_stats() const { return zone_cache_stats; }
+
+    // Read-ahead statistics: zones prefetched, and how many of them were read from the image.
+    uint64_t get_prefetch_count() const { return prefetch_count; }
+    uint64_t get_prefetch_hits() const { return prefetch_hits; }
+
+    // Select when writes are flushed to storage.
+    void set_sync_policy(DiskSync policy, unsigned interval = 0);
+    uint64_t get_sync_count() const { return sync_count; }
+
+    // At the end of job: wait for queued writes,
+    // and flush them to storage unless policy is none.
+    void sync();
+
+    // Overlay: number of zones modified, write them to the image, or forget them.
+    unsigned get_overlay_zone_count() const { return overlay.size(); }
+    void commit_overlay();
+    void discard_overlay() { overlay.clear(); }
 
     // Data transfer.
     void disk_to_memory(unsigned zone, unsigned sector, unsigned addr, unsigned nwords);
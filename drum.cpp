@@ -21,24 +21,167 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 //
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "machine.h"
 
+// Contents of zones not allocated.
+static const Drum::Zone zero_zone{};
+
+//
+// Map drum contents from file.
+// Create the file, or extend it to the full size of the drum, when writable.
+//
+Drum::Drum(Memory &m, const std::string &p, bool write_permit) : memory(m), path(p)
+{
+    const size_t nbytes = NZONES * PAGE_NWORDS * sizeof(Word);
+
+    int fd = open(path.c_str(), write_permit ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path +
+                                 (write_permit ? " for write" : " for read"));
+
+    struct stat stat;
+    if (fstat(fd, &stat) < 0 || (size_t)stat.st_size < nbytes) {
+        if (!write_permit || ftruncate(fd, nbytes) < 0) {
+            close(fd);
+            throw std::runtime_error("Drum file " + path + " is too short");
+        }
+    }
+
+    // Read-only file is mapped copy-on-write: many processes can share it.
+    void *ptr = mmap(nullptr, nbytes, PROT_READ | PROT_WRITE,
+                     write_permit ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        throw std::runtime_error("Cannot map " + path);
+
+    mapping = static_cast<Word *>(ptr);
+}
+
+//
+// Unmap the file. Changes of writable drum are saved by the kernel.
+//
+Drum::~Drum()
+{
+    if (mapping) {
+        munmap(mapping, NZONES * PAGE_NWORDS * sizeof(Word));
+    }
+}
+
 //
 // Drum read: transfer data to memory.
+// Data may span several zones.
 //
 void Drum::drum_to_memory(unsigned zone, unsigned sector, unsigned addr, unsigned nwords)
 {
-    const Word *source = &media[zone * PAGE_NWORDS + sector * SECTOR_NWORDS];
+    unsigned offset = zone * PAGE_NWORDS + sector * SECTOR_NWORDS;
+
+    while (nwords > 0 && offset < NZONES * PAGE_NWORDS) {
+        unsigned start = offset % PAGE_NWORDS;
+        unsigned count = std::min(nwords, PAGE_NWORDS - start);
 
-    memory.write_words(source, nwords, addr);
+        memory.write_words(get_zone(offset / PAGE_NWORDS) + start, count, addr);
+        offset += count;
+        addr += count;
+        nwords -= count;
+    }
 }
 
 //
 // Drum write: transfer data from memory.
+// Data may span several zones.
 //
 void Drum::memory_to_drum(unsigned zone, unsigned sector, unsigned addr, unsigned nwords)
 {
-    Word *destination = &media[zone * PAGE_NWORDS + sector * SECTOR_NWORDS];
+    unsigned offset = zone * PAGE_NWORDS + sector * SECTOR_NWORDS;
+
+    mark_dirty(offset, nwords);
+    while (nwords > 0 && offset < NZONES * PAGE_NWORDS) {
+        unsigned start = offset % PAGE_NWORDS;
+        unsigned count = std::min(nwords, PAGE_NWORDS - start);
+
+        memory.read_words(alloc_zone(offset / PAGE_NWORDS) + start, count, addr);
+        offset += count;
+        addr += count;
+        nwords -= count;
+    }
+}
+
+//
+// Get zone for writing: allocate on first use, filled with zeros.
+//
+Word *Drum::alloc_zone(unsigned zone)
+{
+    if (mapping) {
+        return mapping + zone * PAGE_NWORDS;
+    }
+    if (!zones[zone]) {
+        zones[zone] = std::make_unique<Zone>();
+    }
+    return zones[zone]->data();
+}
+
+//
+// Get contents of the zone.
+//
+const Word *Drum::get_zone(unsigned zone) const
+{
+    if (mapping) {
+        return mapping + zone * PAGE_NWORDS;
+    }
+    return zones[zone] ? zones[zone]->data() : zero_zone.data();
+}
+
+//
+// Overwrite whole zone.
+//
+void Drum::write_zone(unsigned zone, const Word *data)
+{
+    std::copy(data, data + PAGE_NWORDS, alloc_zone(zone));
+    dirty_zones |= 1u << zone;
+}
+
+//
+// Release the zone: it reads as zeros again.
+//
+void Drum::clear_zone(unsigned zone)
+{
+    if (mapping) {
+        std::fill_n(mapping + zone * PAGE_NWORDS, PAGE_NWORDS, 0);
+    } else {
+        zones[zone].reset();
+    }
+    dirty_zones |= 1u << zone;
+}
+
+//
+// Count zones allocated. Drum mapped from file has all of them.
+//
+unsigned Drum::get_zone_count() const
+{
+    if (mapping) {
+        return NZONES;
+    }
+    return std::count_if(zones.begin(), zones.end(), [](auto &z) { return z != nullptr; });
+}
+
+//
+// Mark zones in the range as modified.
+//
+void Drum::mark_dirty(unsigned offset, unsigned nwords)
+{
+    if (nwords == 0)
+        return;
 
-    memory.read_words(destination, nwords, addr);
+    unsigned first = offset / PAGE_NWORDS;
+    unsigned last  = (offset + nwords - 1) / PAGE_NWORDS;
+    for (unsigned zone = first; zone <= last && zone < NZONES; zone++) {
+        dirty_zones |= 1u << zone;
+    }
 }
@@ -24,27 +24,84 @@
 #ifndef DUBNA_DRUM_H
 #define DUBNA_DRUM_H
 
+#include <memory>
+#include <string>
+
 #include "memory.h"
 
 class Drum {
+public:
+    // Number of zones on the drum.
+    static const unsigned NZONES = 040;
+
+    // Zone of 1024 words.
+    using Zone = std::array<Word, PAGE_NWORDS>;
+
 private:
     // Reference to the BESM-6 memory.
     Memory &memory;
 
-    // Drum contents.
-    std::array<Word, 040 * PAGE_NWORDS> media;
+    // Drum contents: zones are allocated on first write.
+    // Zones not allocated read as zeros.
+    std::array<std::unique_ptr<Zone>, NZONES> zones;
+
+    // Contents mapped from file, when present: used instead of zones.
+    Word *mapping{};
+    std::string path;
+
+    // Zones modified since last clear_dirty_zones(), one bit per zone.
+    uint32_t dirty_zones{};
+
+    Word *alloc_zone(unsigned zone);
+    void mark_dirty(unsigned offset, unsigned nwords);
 
 public:
-    // Constructor.
+    // Constructor: drum in memory.
     explicit Drum(Memory &m) : memory(m) {}
 
+    // Constructor: drum mapped from file, created when missing.
+    // Read-only file is mapped privately: writes are not saved.
+    Drum(Memory &m, const std::string &path, bool write_permit);
+
+    // Unmap the file.
+    ~Drum();
+
+    // Cannot copy the Drum object.
+    Drum(const Drum &)            = delete;
+    Drum &operator=(const Drum &) = delete;
+
+    // Drum is mapped from file.
+    bool is_file_backed() const { return mapping != nullptr; }
+    const std::string &get_path() const { return path; }
+
     // Data transfer.
     void drum_to_memory(unsigned zone, unsigned sector, unsigned addr, unsigned nwords);
     void memory_to_drum(unsigned zone, unsigned sector, unsigned addr, unsigned nwords);
 
     // Single word access.
-    void write_word(unsigned offset, Word value) { media[offset] = value; }
-    Word read_word(unsigned offset) { return media[offset]; }
+    void write_word(unsigned offset, Word value)
+    {
+        unsigned zone = offset / PAGE_NWORDS;
+        alloc_zone(zone)[offset % PAGE_NWORDS] = value;
+        dirty_zones |= 1u << zone;
+    }
+    Word read_word(unsigned offset) const
+    {
+        return get_zone(offset / PAGE_NWORDS)[offset % PAGE_NWORDS];
+    }
+
+    // Whole zone access, for checkpoints and snapshots.
+    const Word *get_zone(unsigned zone) const;
+    void write_zone(unsigned zone, const Word *data);
+    void clear_zone(unsigned zone);
+    bool is_zone_allocated(unsigned zone) const { return mapping || zones[zone]; }
+
+    // Occupancy: number of zones allocated.
+    unsigned get_zone_count() const;
+
+    // Dirty zones: modified by memory_to_drum(), write_word(), write_zone() or clear_zone().
+    uint32_t get_dirty_zones() const { return dirty_zones; }
+    void clear_dirty_zones() { dirty_zones = 0; }
 };
 
 #endif // DUBNA_DRUM_H
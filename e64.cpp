@@ -63,19 +63,21 @@ void Processor::e64_emit_line()
 //
 void Processor::e64_flush_line()
 {
+    auto &out = machine.get_output();
+
     // Emit line separator: newpage or several newlines or nothing.
     if (e64_skip_lines < 0) {
         // New page.
-        if (isatty(1)) {
+        if (&out == &std::cout && isatty(1)) {
             // Output to a terminal: replace FormFeed by a NewLine.
-            std::cout << std::endl;
+            out << std::endl;
         } else {
-            std::cout << '\f' << std::flush;
+            out << '\f' << std::flush;
         }
     } else {
         // Zero or more newlines.
         for (; e64_skip_lines > 0; e64_skip_lines--) {
-            std::cout << std::endl;
+            out << std::endl;
         }
     }
     e64_skip_lines = 1;
@@ -91,7 +93,7 @@ void Processor::e64_flush_line()
 
         if (e64_line[limit] != GOST_SPACE) {
             // Write the line to the output.
-            gost_write(e64_line, limit);
+            gost_write(out, e64_line, limit);
             e64_line_count++;
 
             // Erase the line: fill with spaces.
@@ -111,7 +113,7 @@ void Processor::e64_finish()
             // Emit previous line.
             e64_emit_line();
         }
-        std::cout << std::endl;
+        machine.get_output() << std::endl;
         e64_line_count = 0;
     }
 }
@@ -137,7 +139,7 @@ void Processor::e64_putchar(int ch)
             // In overprint mode: cannot overwrite previous character.
             // Emit the line with overprint indicator (backslash).
             e64_flush_line();
-            std::cout << '\\';
+            machine.get_output() << '\\';
         }
         e64_line[e64_position] = ch;
     }
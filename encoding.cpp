@@ -72,16 +72,16 @@ unsigned gost_to_unicode(unsigned char ch)
 }
 
 //
-// Write GOST-10859 string to stdout.
+// Write GOST-10859 string to the given stream.
 // Convert to local encoding UTF-8.
 //
-void gost_write(const std::string &line, unsigned limit)
+void gost_write(std::ostream &out, const std::string &line, unsigned limit)
 {
     for (unsigned i = 0; i <= limit; i++) {
         unsigned ch = gost_to_unicode(line[i]);
         if (!ch)
             ch = ' ';
-        utf8_putc(ch);
+        utf8_putc(out, ch);
     }
 }
 
@@ -101,37 +101,37 @@ bool is_gost_end_of_text(unsigned char ch)
 }
 
 //
-// Write Unicode symbol to stdout.
+// Write Unicode symbol to the given stream.
 // Convert to UTF-8 encoding:
 // 00000000.0xxxxxxx -> 0xxxxxxx
 // 00000xxx.xxyyyyyy -> 110xxxxx, 10yyyyyy
 // xxxxyyyy.yyzzzzzz -> 1110xxxx, 10yyyyyy, 10zzzzzz
 //
-void utf8_putc(unsigned ch)
+void utf8_putc(std::ostream &out, unsigned ch)
 {
 #if 0
     static int initialized = 0;
 
     if (!initialized) {
         // Write UTF-8 tag: zero width no-break space.
-        std::cout << (char)0xEF;
-        std::cout << (char)0xBB;
-        std::cout << (char)0xBF;
+        out << (char)0xEF;
+        out << (char)0xBB;
+        out << (char)0xBF;
         initialized = 1;
     }
 #endif
     if (ch < 0x80) {
-        std::cout << (char)ch;
+        out << (char)ch;
         return;
     }
     if (ch < 0x800) {
-        std::cout << (char)(ch >> 6 | 0xc0);
-        std::cout << (char)((ch & 0x3f) | 0x80);
+        out << (char)(ch >> 6 | 0xc0);
+        out << (char)((ch & 0x3f) | 0x80);
         return;
     }
-    std::cout << (char)(ch >> 12 | 0xe0);
-    std::cout << (char)(((ch >> 6) & 0x3f) | 0x80);
-    std::cout << (char)((ch & 0x3f) | 0x80);
+    out << (char)(ch >> 12 | 0xe0);
+    out << (char)(((ch >> 6) & 0x3f) | 0x80);
+    out << (char)((ch & 0x3f) | 0x80);
 }
 
 //
@@ -21,13 +21,14 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 //
+#include <iosfwd>
 #include <string>
 
 //
-// Write GOST-10859 string to stdout.
+// Write GOST-10859 string to the given stream.
 // Convert to local encoding UTF-8.
 //
-void gost_write(const std::string &line, unsigned limit);
+void gost_write(std::ostream &out, const std::string &line, unsigned limit);
 
 //
 // Convert character in GOST-10859 encoding to Unicode.
@@ -40,9 +41,9 @@ unsigned gost_to_unicode(unsigned char ch);
 bool is_gost_end_of_text(unsigned char ch);
 
 //
-// Write Unicode symbol to stdout in UTF-8 encoding.
+// Write Unicode symbol to the given stream in UTF-8 encoding.
 //
-void utf8_putc(unsigned ch);
+void utf8_putc(std::ostream &out, unsigned ch);
 
 //
 // Fetch Unicode symbol from UTF-8 string.
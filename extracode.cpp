@@ -78,7 +78,8 @@ void Processor::extracode(unsigned opcode)
         break;
 
     case 074: // Finish the job.
-        throw Exception("");
+        job_done = true;
+        break;
 
     case 075: // Write to memory with instruction check bits.
         e75();
@@ -396,7 +397,8 @@ void Processor::e76()
     default:
         if (addr >= 10) {
             // Print warning.
-            std::cerr << "--- Ignore extracode *76 " + to_octal(core.M[016]) << std::endl;
+            machine.get_error_output() << "--- Ignore extracode *76 " + to_octal(core.M[016])
+                                       << std::endl;
             return;
         }
         throw Exception("Unimplemented extracode *76 " + to_octal(addr));
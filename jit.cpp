@@ -0,0 +1,498 @@
+//
+// Translator of superblocks into host x86-64 code.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include "jit.h"
+
+#include <cstring>
+#include <utility>
+
+#include "aot.h"
+#include "machine.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_ENABLED 1
+#endif
+
+//
+// Translate superblock after so many executions.
+//
+static const unsigned JIT_THRESHOLD = 32;
+
+//
+// Translated superblock:
+//
+//      push  rbx                   ; prologue
+//      push  r12
+//      sub   rsp, 8
+//      mov   rbx, rdi              ; rbx = Processor
+//      mov   r12, rsi              ; r12 = CoreState
+//
+//      ...                         ; host code of instructions, or calls:
+//      mov   rdi, rbx              ;   helper(cpu, reg, addr)
+//      mov   esi, reg
+//      mov   edx, addr
+//      mov   rax, helper
+//      call  rax
+//      test  eax, eax
+//      jnz   exit_k                ;   leave the block after instruction #k
+//
+//      mov   eax, length           ; whole block executed
+// epilogue:
+//      add   rsp, 8
+//      pop   r12
+//      pop   rbx
+//      ret
+//
+// exit_k:
+//      mov   eax, k+1
+//      jmp   epilogue
+//
+static const unsigned OFFSET_PC    = offsetof(CoreState, PC);
+static const unsigned OFFSET_RIGHT = offsetof(CoreState, right_instr_flag);
+static const unsigned OFFSET_M     = offsetof(CoreState, M);
+
+//
+// Append code to the buffer.
+//
+void Jit::emit(std::initializer_list<uint8_t> bytes)
+{
+    buf.insert(buf.end(), bytes);
+}
+
+void Jit::emit32(uint32_t val)
+{
+    emit({ uint8_t(val), uint8_t(val >> 8), uint8_t(val >> 16), uint8_t(val >> 24) });
+}
+
+void Jit::emit64(uint64_t val)
+{
+    emit32(val);
+    emit32(val >> 32);
+}
+
+//
+// mov dword [r12 + offset], val
+//
+void Jit::emit_store(unsigned offset, uint32_t val)
+{
+    emit({ 0x41, 0xc7, 0x84, 0x24 });
+    emit32(offset);
+    emit32(val);
+}
+
+//
+// mov byte [r12 + offset], val
+//
+void Jit::emit_store_byte(unsigned offset, uint8_t val)
+{
+    emit({ 0x41, 0xc6, 0x84, 0x24 });
+    emit32(offset);
+    emit({ val });
+}
+
+//
+// mov eax, dword [r12 + offset]
+//
+void Jit::emit_load_eax(unsigned offset)
+{
+    emit({ 0x41, 0x8b, 0x84, 0x24 });
+    emit32(offset);
+}
+
+//
+// mov dword [r12 + offset], eax
+//
+void Jit::emit_store_eax(unsigned offset)
+{
+    emit({ 0x41, 0x89, 0x84, 0x24 });
+    emit32(offset);
+}
+
+//
+// cmp dword [r12 + offset], 0
+//
+void Jit::emit_compare_zero(unsigned offset)
+{
+    emit({ 0x41, 0x83, 0xbc, 0x24 });
+    emit32(offset);
+    emit({ 0 });
+}
+
+//
+// Conditional branch forward: jz (0x84) or jnz (0x85).
+// Return position of the offset, to patch later.
+//
+size_t Jit::emit_branch(uint8_t opcode)
+{
+    emit({ 0x0f, opcode });
+    emit32(0);
+    return buf.size() - 4;
+}
+
+//
+// Make the branch at the given position jump to the end of buffer.
+//
+void Jit::patch_branch(size_t pos)
+{
+    uint32_t offset = buf.size() - (pos + 4);
+    std::memcpy(&buf[pos], &offset, sizeof(offset));
+}
+
+//
+// Set PC and right_instr_flag, unless they already have these values.
+//
+void Jit::emit_set_pc(unsigned pc, bool right)
+{
+    if (known_pc != pc) {
+        emit_store(OFFSET_PC, pc);
+        known_pc = pc;
+    }
+    if (known_right != right) {
+        emit_store_byte(OFFSET_RIGHT, right);
+        known_right = right;
+    }
+}
+
+//
+// Jump: PC = addr, right_instr_flag = false.
+//
+void Jit::emit_jump(unsigned addr)
+{
+    emit_store(OFFSET_PC, addr);
+    emit_store_byte(OFFSET_RIGHT, 0);
+}
+
+//
+// Call helper for instruction #count-1.
+// Leave the block when the helper returns non-zero.
+//
+void Jit::emit_call(Helper helper, unsigned reg, unsigned addr, unsigned count)
+{
+    emit({ 0x48, 0x89, 0xdf }); // mov rdi, rbx
+    emit({ 0xbe });             // mov esi, reg
+    emit32(reg);
+    emit({ 0xba });             // mov edx, addr
+    emit32(addr);
+    emit({ 0x48, 0xb8 });       // mov rax, helper
+    emit64(reinterpret_cast<uint64_t>(helper));
+    emit({ 0xff, 0xd0 });       // call rax
+    emit({ 0x85, 0xc0 });       // test eax, eax
+    exits.emplace_back(emit_branch(0x85), count);
+}
+
+//
+// Translate instruction into host code, when possible.
+// PC and right_instr_flag are already advanced past this instruction.
+// Return false when the instruction needs a helper.
+//
+bool Jit::emit_native(const Instruction &ins, unsigned pc, bool right)
+{
+    const unsigned m_reg = OFFSET_M + ins.reg * sizeof(unsigned);
+    size_t skip;
+
+    switch (ins.opcode) {
+    case 0240: // уиа, vtm
+        if (ins.reg) {
+            emit_store(m_reg, ins.addr);
+        }
+        emit_store(OFFSET_M, 0);
+        return true;
+
+    case 0250: // слиа, utm
+        if (ins.reg) {
+            emit_load_eax(m_reg);
+            emit({ 0x05 }); // add eax, addr
+            emit32(ins.addr);
+            emit({ 0x25 }); // and eax, 077777
+            emit32(BITS(15));
+            emit_store_eax(m_reg);
+        }
+        emit_store(OFFSET_M, 0);
+        return true;
+
+    case 0300: // пб, uj
+        emit_load_eax(m_reg);
+        emit({ 0x05 }); // add eax, addr
+        emit32(ins.addr);
+        emit({ 0x25 }); // and eax, 077777
+        emit32(BITS(15));
+        emit_store_eax(OFFSET_PC);
+        emit_store_byte(OFFSET_RIGHT, 0);
+        return true;
+
+    case 0310: // пв, vjm
+        if (ins.reg) {
+            emit_store(m_reg, right ? ADDR(pc + 1) : ADDR(pc));
+        }
+        emit_store(OFFSET_M, 0);
+        emit_jump(ins.addr);
+        return true;
+
+    case 0340: // пио, vzm
+    case 0360: // э36, *36
+        emit_set_pc(pc, right);
+        emit_compare_zero(m_reg);
+        skip = emit_branch(0x85); // jnz
+        emit_jump(ins.addr);
+        patch_branch(skip);
+        return true;
+
+    case 0350: // пино, v1m
+        emit_set_pc(pc, right);
+        emit_compare_zero(m_reg);
+        skip = emit_branch(0x84); // jz
+        emit_jump(ins.addr);
+        patch_branch(skip);
+        return true;
+
+    case 0370: // цикл, vlm
+        emit_set_pc(pc, right);
+        emit_compare_zero(m_reg);
+        skip = emit_branch(0x84); // jz
+        emit_load_eax(m_reg);
+        emit({ 0x83, 0xc0, 0x01 }); // add eax, 1
+        emit({ 0x25 });             // and eax, 077777
+        emit32(BITS(15));
+        emit_store_eax(m_reg);
+        emit_jump(ins.addr);
+        patch_branch(skip);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+//
+// Allocate region for code.
+// Pages are never writable and executable at the same time:
+// they become executable when the code is written, see install().
+//
+Jit::Jit()
+{
+#ifdef JIT_ENABLED
+    void *ptr = mmap(nullptr, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0);
+    if (ptr != MAP_FAILED) {
+        region = static_cast<uint8_t *>(ptr);
+    }
+#endif
+}
+
+//
+// Release region for code.
+//
+Jit::~Jit()
+{
+#ifdef JIT_ENABLED
+    if (region) {
+        munmap(region, REGION_SIZE);
+    }
+#endif
+}
+
+//
+// Translate instructions into host code.
+// Return nullptr when the region is full, or executable memory is denied.
+//
+Jit::Code Jit::translate(const Instruction *code, unsigned length, unsigned start,
+                         const Helper *helpers, const Helper *mod_helpers)
+{
+    if (!region) {
+        return nullptr;
+    }
+    buf.clear();
+    exits.clear();
+    known_pc    = ~0u;
+    known_right = -1;
+
+    emit({ 0x53 });                   // push rbx
+    emit({ 0x41, 0x54 });             // push r12
+    emit({ 0x48, 0x83, 0xec, 0x08 }); // sub rsp, 8
+    emit({ 0x48, 0x89, 0xfb });       // mov rbx, rdi
+    emit({ 0x49, 0x89, 0xf4 });       // mov r12, rsi
+
+    unsigned pc   = start / 2;
+    bool right    = start & 1;
+    bool modified = false; // address modifier from previous utc/wtc
+    bool jumped   = false; // PC is set by uj or vjm
+    for (unsigned k = 0; k < length; k++) {
+        const Instruction &ins = code[k];
+
+        // Advance PC past this instruction.
+        if (right) {
+            pc += 1;
+            right = false;
+        } else {
+            right = true;
+        }
+
+        if (!modified && emit_native(ins, pc, right)) {
+            jumped = (ins.opcode == 0300 || ins.opcode == 0310);
+        } else {
+            emit_set_pc(pc, right);
+            emit_call(modified ? mod_helpers[ins.opcode] : helpers[ins.entry], ins.reg, ins.addr, k + 1);
+        }
+        modified = (ins.opcode == 0220 || ins.opcode == 0230);
+    }
+    if (!jumped) {
+        // Continue from the next instruction, unless the block has changed PC.
+        emit_set_pc(pc, right);
+    }
+    emit({ 0xb8 }); // mov eax, length
+    emit32(length);
+
+    size_t epilogue = buf.size();
+    emit({ 0x48, 0x83, 0xc4, 0x08 }); // add rsp, 8
+    emit({ 0x41, 0x5c });             // pop r12
+    emit({ 0x5b });                   // pop rbx
+    emit({ 0xc3 });                   // ret
+
+    for (auto const &exit : exits) {
+        patch_branch(exit.first);
+        emit({ 0xb8 }); // mov eax, count
+        emit32(exit.second);
+        emit({ 0xe9 }); // jmp epilogue
+        emit32(epilogue - (buf.size() + 4));
+    }
+
+    if (used + buf.size() > REGION_SIZE) {
+        return nullptr;
+    }
+    return install();
+}
+
+//
+// Copy generated code into the region.
+// Pages are made writable for the copy, then executable again.
+// When the system denies executable memory, release the region:
+// translation is not available anymore.
+//
+Jit::Code Jit::install()
+{
+#ifdef JIT_ENABLED
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t first                  = used & ~(page_size - 1);
+    size_t nbytes                 = used + buf.size() - first;
+    if (mprotect(region + first, nbytes, PROT_READ | PROT_WRITE) < 0) {
+        return nullptr;
+    }
+    uint8_t *ptr = region + used;
+    std::memcpy(ptr, buf.data(), buf.size());
+    if (mprotect(region + first, nbytes, PROT_READ | PROT_EXEC) < 0) {
+        munmap(region, REGION_SIZE);
+        region = nullptr;
+        used   = 0;
+        return nullptr;
+    }
+    used += buf.size();
+    return reinterpret_cast<Code>(ptr);
+#else
+    return nullptr;
+#endif
+}
+
+//
+// Simulate up to the given number of instructions, using translated superblocks.
+// Stop after extracode. Return true when the processor is stopped.
+// Blocks translated ahead of time are used right away, see aot.h.
+// Without executable memory, use only those, or superblocks of the interpreter.
+//
+bool Processor::run_jit(uint64_t budget)
+{
+    if (!jit) {
+        jit = std::make_unique<Jit>();
+    }
+    if (!jit->available() && aot_nblocks == 0) {
+        return run_blocks(budget);
+    }
+
+    // Cold blocks are interpreted and don't return after extracode:
+    // check for e74 and for pause here.
+    Block *block = nullptr;
+    while (budget > 0 && !job_done && !pause) {
+        if (core.apply_mod_reg) {
+            // Previous block has ended with utc/wtc:
+            // execute modified instruction by interpreter.
+            if (run_threaded(1)) {
+                return true;
+            }
+            budget--;
+            block = nullptr;
+            continue;
+        }
+
+        block = next_block(block);
+        if (block->length > budget) {
+            // Not enough budget for whole block: finish by single instructions.
+            return run_threaded(budget);
+        }
+        if (!block->native) {
+            if (++block->hits < JIT_THRESHOLD || !jit->available()) {
+                // Not hot yet, or no translation on this host: interpret.
+                uint64_t count0 = machine.get_instr_count();
+                if (run_threaded(block->length)) {
+                    return true;
+                }
+                budget -= machine.get_instr_count() - count0;
+                continue;
+            }
+            block->native = jit->translate(&decoded[block->start], block->length, block->start,
+                                           jit_helpers(false), jit_helpers(true));
+            if (!block->native) {
+                // Region is full: forget all translations and start over.
+                // When executable memory is denied, jit is not available anymore.
+                flush_blocks(~0u);
+                jit->reset();
+                block = nullptr;
+                continue;
+            }
+        }
+
+        unsigned count = block->native(*this, core);
+        if (jit_exception) {
+            // Instruction which has raised exception is not counted.
+            machine.add_simulated_instructions(count - 1);
+            std::rethrow_exception(std::exchange(jit_exception, nullptr));
+        }
+        machine.add_simulated_instructions(count);
+        budget -= count;
+
+        if (count == block->length) {
+            unsigned opcode = decoded[block->start + count - 1].opcode;
+            if (opcode == 0330) {
+                // стоп, stop: we are done.
+                return true;
+            }
+            if (is_extracode(opcode)) {
+                return false;
+            }
+            if (block->loop_reg) {
+                budget -= skip_loop(block, budget);
+            }
+        }
+    }
+    return false;
+}
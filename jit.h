@@ -0,0 +1,116 @@
+//
+// Translator of superblocks into host x86-64 code.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#ifndef DUBNA_JIT_H
+#define DUBNA_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+class Processor;
+struct CoreState;
+struct Instruction;
+
+//
+// Translated code lives in memory region, allocated with mmap().
+// Pages of the region are either writable or executable, never both.
+// Jumps and index register instructions are translated into host code,
+// other instructions become calls of helpers with constant operands.
+// When the host is not x86-64, or executable memory is not available,
+// nothing is translated and the caller falls back to the interpreter.
+//
+class Jit {
+public:
+    // Translated superblock.
+    // Return number of instructions executed, including the one
+    // which has left the block.
+    using Code = unsigned (*)(Processor &cpu, CoreState &core);
+
+    // Execute one instruction. Return non-zero to leave the block.
+    using Helper = unsigned (*)(Processor &cpu, unsigned reg, unsigned addr);
+
+private:
+    // Size of executable region.
+    static const size_t REGION_SIZE = 4 * 1024 * 1024;
+
+    uint8_t *region{}; // memory for code
+    size_t used{};     // bytes of region occupied by code
+
+    // Code being generated.
+    std::vector<uint8_t> buf;
+
+    // Exits from the block: positions of jump offsets, and instruction counts.
+    std::vector<std::pair<size_t, unsigned>> exits;
+
+    // Values of PC and right_instr_flag, known to be in CoreState.
+    unsigned known_pc{};
+    int known_right{};
+
+    // Generate host code.
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit32(uint32_t val);
+    void emit64(uint64_t val);
+    void emit_store(unsigned offset, uint32_t val);
+    void emit_store_byte(unsigned offset, uint8_t val);
+    void emit_load_eax(unsigned offset);
+    void emit_store_eax(unsigned offset);
+    void emit_compare_zero(unsigned offset);
+    size_t emit_branch(uint8_t opcode);
+    void patch_branch(size_t pos);
+    void emit_set_pc(unsigned pc, bool right);
+    void emit_jump(unsigned addr);
+    void emit_call(Helper helper, unsigned reg, unsigned addr, unsigned count);
+    bool emit_native(const Instruction &ins, unsigned pc, bool right);
+
+    // Copy generated code into the region, and make it executable.
+    Code install();
+
+public:
+    // Allocate region for code.
+    Jit();
+
+    // Release region for code.
+    ~Jit();
+
+    // Cannot copy.
+    Jit(const Jit &)            = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    // Is translation possible on this host?
+    bool available() const { return region != nullptr; }
+
+    // Translate instructions into host code, starting from the given
+    // PC*2 + right_instr_flag. Plain helpers are indexed by dispatch entry,
+    // ones which apply address modifier from previous utc/wtc - by opcode.
+    // Return nullptr when the region is full, or executable memory is denied.
+    Code translate(const Instruction *code, unsigned length, unsigned start,
+                   const Helper *helpers, const Helper *mod_helpers);
+
+    // Forget all translated code.
+    void reset() { used = 0; }
+};
+
+#endif // DUBNA_JIT_H
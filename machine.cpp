@@ -26,19 +26,19 @@
 #include <unistd.h>
 
 #include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
 #include "encoding.h"
 
-// Static fields.
-bool Machine::verbose                    = false;
-uint64_t Machine::simulated_instructions = 0;
-
 // Limit of instructions, by default.
 const uint64_t Machine::DEFAULT_LIMIT = 100ULL * 1000 * 1000 * 1000;
 
+// Check the real time every few thousand cycles.
+static const uint64_t PROGRESS_INCREMENT = 10000;
+
 //
 // Initialize the machine.
 //
@@ -61,11 +61,6 @@ Machine::~Machine()
 //
 void Machine::show_progress()
 {
-    //
-    // Check the real time every few thousand cycles.
-    //
-    static const uint64_t PROGRESS_INCREMENT = 10000;
-
     if (simulated_instructions >= progress_count + PROGRESS_INCREMENT) {
         progress_count += PROGRESS_INCREMENT;
 
@@ -84,93 +79,297 @@ void Machine::show_progress()
 
 //
 // Run the machine until completion.
+// Limit and progress are checked only when the budget of instructions is used up.
 //
 void Machine::run()
 {
     // Show initial state.
     trace_registers();
 
+    if (!boot_printout.empty()) {
+        // Started from snapshot: show what the monitor has printed before.
+        *output << boot_printout;
+        boot_printout.clear();
+    }
+    if (!snapshot_file.empty() || stop_at_deck) {
+        // Keep printer output until snapshot point.
+        begin_boot_capture();
+    }
+
+    // Choose the engine once, for the whole run.
+    Processor::Runner engine_run;
+    if (engine == Engine::STEP) {
+        engine_run = &Processor::run_step;
+    } else if (trace_enabled() || watch_fetch_pages) {
+        // Superblocks skip the trace, and fetch of decoded instructions:
+        // use threaded dispatch with trace.
+        engine_run = &Processor::run_traced;
+    } else if (engine == Engine::BLOCK) {
+        engine_run = &Processor::run_blocks;
+    } else if (engine == Engine::JIT) {
+        engine_run = &Processor::run_jit;
+    } else {
+        engine_run = &Processor::run_threaded;
+    }
+
     try {
         for (;;) {
-            bool done = cpu.step();
+            // Run until the limit, or until next progress check.
+            uint64_t budget = (simulated_instructions <= instr_limit)
+                                  ? instr_limit + 1 - simulated_instructions
+                                  : 1;
+            if (progress_message_enabled && budget > PROGRESS_INCREMENT) {
+                budget = PROGRESS_INCREMENT;
+            }
+            if (checkpoint_interval != 0) {
+                if (simulated_instructions >= next_checkpoint) {
+                    take_checkpoint();
+                }
+                if (budget > next_checkpoint - simulated_instructions) {
+                    budget = next_checkpoint - simulated_instructions;
+                }
+            }
 
-            if (progress_message_enabled) {
-                show_progress();
+            auto reason = cpu.run(engine_run, budget);
+            if (reason == StopReason::LIMIT && simulated_instructions <= instr_limit) {
+                // Budget was cut for the progress check or for the checkpoint.
+                reason = StopReason::PROGRESS;
             }
-            simulated_instructions++;
-            if (simulated_instructions > instr_limit)
+            switch (reason) {
+            case StopReason::PROGRESS:
+                if (progress_message_enabled) {
+                    show_progress();
+                }
+                break;
+
+            case StopReason::PAUSE:
+                // Snapshot point is reached.
+                if (stop_at_deck) {
+                    // Show the output later, with the job.
+                    boot_printout = end_boot_capture();
+                    return;
+                }
+                save_snapshot(snapshot_file);
+                snapshot_file.clear();
+                flush_boot_capture();
+                break;
+
+            case StopReason::LIMIT:
                 throw std::runtime_error("Simulation limit exceeded");
 
-            if (done) {
+            case StopReason::HALT:
                 // Halted by 'стоп' instruction.
+            case StopReason::FINISH:
+                // Legally halted by extracode e74.
+                flush_boot_capture();
                 cpu.finish();
                 return;
-            }
-        }
 
-    } catch (const Processor::Exception &ex) {
-        // Unexpected situation in the machine.
-        cpu.stack_correction();
-        cpu.finish();
-
-        auto const *message = ex.what();
-        if (!message[0]) {
-            // Empty message - legally halted by extracode e74.
-            return;
+            case StopReason::FAULT:
+                // Unexpected situation in the machine.
+                flush_boot_capture();
+                cpu.finish();
+                *error_output << "Error: " << cpu.get_fault() << std::endl;
+                trace_exception(cpu.get_fault().c_str());
+                throw 0;
+            }
         }
-        std::cerr << "Error: " << message << std::endl;
-        trace_exception(message);
-        throw 0;
 
     } catch (std::exception &ex) {
         // Something else.
-        std::cerr << "Error: " << ex.what() << std::endl;
+        flush_boot_capture();
+        *error_output << "Error: " << ex.what() << std::endl;
         throw 0;
     }
 }
 
 //
-// Fetch instruction word.
+// Start capturing the printer output, for snapshot.
+// Trace still goes to the real output.
 //
-Word Machine::mem_fetch(unsigned addr)
+void Machine::begin_boot_capture()
 {
-    if (addr == 0) {
-        throw Processor::Exception("Jump to zero");
+    if (!job_output) {
+        job_output = output;
+        output     = &boot_capture;
+        if (!trace_stream) {
+            trace_stream = job_output;
+        }
     }
+}
 
-    Word val = memory.load(addr);
+//
+// Stop capturing the printer output.
+// Return the text captured.
+//
+std::string Machine::end_boot_capture()
+{
+    if (!job_output) {
+        return "";
+    }
+    if (trace_stream == job_output) {
+        trace_stream = nullptr;
+    }
+    output     = job_output;
+    job_output = nullptr;
+    return boot_capture.str();
+}
 
-    if (!cpu.on_right_instruction()) {
-        trace_fetch(addr, val);
+//
+// Stop capturing, and show the text captured.
+//
+void Machine::flush_boot_capture()
+{
+    auto text = end_boot_capture();
+    *output << text;
+}
+
+//
+// Run the monitor until it reads the job deck.
+// Keep the printer output, to be shown when the job is run.
+//
+void Machine::run_until_deck_read()
+{
+    stop_at_deck = true;
+    run();
+    stop_at_deck = false;
+    if (deck_read.nwords == 0)
+        throw std::runtime_error("Monitor has finished before reading the job deck");
+}
+
+//
+// Repeat the first read of the job deck, made by the monitor.
+//
+void Machine::reread_deck()
+{
+    drum_io('r', 1, deck_read.zone, deck_read.sector, deck_read.addr, deck_read.nwords);
+}
+
+//
+// Watch memory range, given as ADDR[:LEN][:MODE], in octal.
+// Throw exception on bad spec.
+//
+void Machine::add_watchpoint(const std::string &spec)
+{
+    std::istringstream in(spec);
+    std::string field;
+    std::vector<std::string> fields;
+    while (std::getline(in, field, ':')) {
+        fields.push_back(field);
+    }
+    if (fields.empty() || fields.size() > 3)
+        throw std::runtime_error("Bad watchpoint '" + spec + "'");
+
+    // Parse octal number, below 0100000.
+    auto parse_octal = [&](const std::string &str) -> unsigned {
+        char *end;
+        unsigned long val = std::strtoul(str.c_str(), &end, 8);
+        if (str.empty() || *end != 0 || val >= MEMORY_NWORDS)
+            throw std::runtime_error("Bad watchpoint '" + spec + "'");
+        return val;
+    };
+    Watchpoint wp{ parse_octal(fields[0]), 1, WATCH_WRITE };
+    if (fields.size() == 3 || (fields.size() == 2 && isdigit(fields[1][0]))) {
+        wp.nwords = parse_octal(fields[1]);
+    }
+    if (fields.size() == 3 || (fields.size() == 2 && !isdigit(fields[1][0]))) {
+        wp.mode = 0;
+        for (char ch : fields.back()) {
+            switch (ch) {
+            case 'r':
+                wp.mode |= WATCH_READ;
+                break;
+            case 'w':
+                wp.mode |= WATCH_WRITE;
+                break;
+            case 'x':
+                wp.mode |= WATCH_FETCH;
+                break;
+            case 's':
+                wp.mode |= WATCH_STOP;
+                break;
+            default:
+                throw std::runtime_error("Bad watchpoint '" + spec + "'");
+            }
+        }
+    }
+    if (wp.nwords == 0 || wp.addr + wp.nwords > MEMORY_NWORDS || !(wp.mode & ~WATCH_STOP))
+        throw std::runtime_error("Bad watchpoint '" + spec + "'");
+
+    // Mark pages of the range.
+    watchpoints.push_back(wp);
+    unsigned first = wp.addr / PAGE_NWORDS;
+    unsigned last  = (wp.addr + wp.nwords - 1) / PAGE_NWORDS;
+    for (unsigned page = first; page <= last; page++) {
+        if (wp.mode & WATCH_READ)
+            watch_read_pages |= 1u << page;
+        if (wp.mode & WATCH_WRITE)
+            watch_write_pages |= 1u << page;
+        if (wp.mode & WATCH_FETCH)
+            watch_fetch_pages |= 1u << page;
     }
-    return val & BITS48;
 }
 
 //
-// Write word to memory.
+// Access to a watched page: check watchpoints.
+// Print the hit to the trace, and stop when requested.
 //
-void Machine::mem_store(unsigned addr, Word val)
+void Machine::watch_access(unsigned mode, unsigned addr, Word val)
 {
-    addr &= BITS(15);
-    if (addr == 0)
+    for (auto &wp : watchpoints) {
+        if (!(wp.mode & mode) || addr < wp.addr || addr >= wp.addr + wp.nwords)
+            continue;
+
+        // Find the instruction. On read or write, PC is already advanced past it.
+        unsigned pc = cpu.get_pc();
+        bool right  = false;
+        if (mode != WATCH_FETCH) {
+            right = !cpu.on_right_instruction();
+            if (right)
+                pc = ADDR(pc - 1);
+        }
+        const char *opname = (mode == WATCH_READ)    ? "Read"
+                             : (mode == WATCH_WRITE) ? "Write"
+                                                     : "Fetch";
+        print_watch(addr, val, opname, pc, right);
+
+        if (wp.mode & WATCH_STOP)
+            throw Processor::Exception(std::string("Watchpoint ") + opname + " [" +
+                                       to_octal(addr) + "]");
         return;
+    }
+}
 
-    memory.store(addr, val);
-    trace_memory_write(addr, val);
+//
+// Get execution engine by name.
+//
+Machine::Engine Machine::engine_by_name(const std::string &name)
+{
+    if (name == "step")
+        return Engine::STEP;
+    if (name == "threaded")
+        return Engine::THREADED;
+    if (name == "block")
+        return Engine::BLOCK;
+    if (name == "jit")
+        return Engine::JIT;
+    throw std::runtime_error("Unknown engine '" + name + "'");
 }
 
 //
-// Read word from memory.
+// Fetch instruction word.
 //
-Word Machine::mem_load(unsigned addr)
+Word Machine::mem_fetch(unsigned addr)
 {
-    addr &= BITS(15);
-    if (addr == 0)
-        return 0;
+    if (addr == 0) {
+        throw Processor::Exception("Jump to zero");
+    }
 
     Word val = memory.load(addr);
-    trace_memory_read(addr, val);
 
+    if (!cpu.on_right_instruction()) {
+        trace_fetch(addr, val);
+    }
     return val & BITS48;
 }
 
@@ -248,6 +447,7 @@ void Machine::disk_io(char op, unsigned disk_unit, unsigned zone, unsigned secto
 
     if (op == 'r') {
         disks[disk_unit]->disk_to_memory(zone, sector, addr, nwords);
+        cpu.invalidate(addr, nwords);
 
         // Debug: dump the data.
         if (dump_io_flag) {
@@ -266,7 +466,14 @@ void Machine::drum_io(char op, unsigned drum_unit, unsigned zone, unsigned secto
 {
     drum_init(drum_unit);
     if (op == 'r') {
+        if (drum_unit == 1 && (!snapshot_file.empty() || stop_at_deck) &&
+            deck_read.nwords == 0) {
+            // Monitor starts reading the job deck: take snapshot after this instruction.
+            deck_read = { zone, sector, addr, nwords };
+            cpu.request_pause();
+        }
         drums[drum_unit]->drum_to_memory(zone, sector, addr, nwords);
+        cpu.invalidate(addr, nwords);
     } else {
         drums[drum_unit]->memory_to_drum(zone, sector, addr, nwords);
     }
@@ -290,8 +497,23 @@ Word Machine::drum_read_word(unsigned drum_unit, unsigned offset)
     return drums[drum_unit]->read_word(offset);
 }
 
+//
+// Count zones allocated in all drums.
+//
+unsigned Machine::get_drum_zone_count() const
+{
+    unsigned count = 0;
+    for (auto &drum : drums) {
+        if (drum) {
+            count += drum->get_zone_count();
+        }
+    }
+    return count;
+}
+
 //
 // Allocate drum on first access.
+// Zones of the drum are allocated on first write.
 //
 void Machine::drum_init(unsigned drum_unit)
 {
@@ -304,6 +526,23 @@ void Machine::drum_init(unsigned drum_unit)
     }
 }
 
+//
+// Map drum contents from file.
+//
+void Machine::drum_mount(unsigned drum_unit, const std::string &filename, bool write_permit)
+{
+    if (drum_unit >= NDRUMS)
+        throw std::runtime_error("Invalid drum unit " + to_octal(drum_unit) + " in drum_mount()");
+
+    if (drums[drum_unit])
+        throw std::runtime_error("Drum unit " + to_octal(drum_unit) + " is already in use");
+
+    drums[drum_unit] = std::make_unique<Drum>(memory, filename, write_permit);
+
+    *output << "Mount file '" << filename << "' as drum " << to_octal(drum_unit)
+            << (write_permit ? "" : ", read only") << std::endl;
+}
+
 //
 // Open binary image and assign it to the disk unit.
 //
@@ -317,10 +556,114 @@ void Machine::disk_mount(unsigned disk_unit, const std::string &filename, bool w
         throw std::runtime_error("Disk unit " + to_octal(disk_unit + 030) + " is already mounted");
 
     // Open binary image as disk.
-    auto path        = disk_find(filename);
-    disks[disk_unit] = std::make_unique<Disk>(memory, path, write_permit);
+    // Read-only image is opened once for all machines sharing the cache.
+    // With overlay, writable image is opened read-only as well.
+    auto path         = disk_find(filename);
+    bool with_overlay = write_permit && disk_overlay;
+    if (!write_permit || with_overlay) {
+        auto image       = disk_cache ? disk_cache->open(path)
+                                      : std::make_shared<DiskImage>(path, false);
+        disks[disk_unit] = std::make_unique<Disk>(memory, image, with_overlay);
+    } else {
+        disks[disk_unit] = std::make_unique<Disk>(memory, path, write_permit);
+    }
+    disks[disk_unit]->set_zone_cache(zone_cache);
+    disks[disk_unit]->set_sync_policy(disk_sync, disk_sync_interval);
+
+    *output << "Mount image '" << path << "' as disk " << to_octal(disk_unit + 030)
+            << (with_overlay ? " with overlay" : "") << std::endl;
+}
 
-    std::cout << "Mount image '" << path << "' as disk " << to_octal(disk_unit + 030) << std::endl;
+//
+// Get statistics of the zone cache, for disks of this machine.
+//
+ZoneCache::Stats Machine::get_zone_cache_stats() const
+{
+    ZoneCache::Stats total;
+    for (auto &disk : disks) {
+        if (disk) {
+            auto &stats = disk->get_zone_cache_stats();
+            total.hits += stats.hits;
+            total.misses += stats.misses;
+            total.evictions += stats.evictions;
+        }
+    }
+    return total;
+}
+
+//
+// Get number of zones prefetched from disk images.
+//
+uint64_t Machine::get_disk_prefetch_count() const
+{
+    uint64_t count = 0;
+    for (auto &disk : disks) {
+        if (disk) {
+            count += disk->get_prefetch_count();
+        }
+    }
+    return count;
+}
+
+//
+// Get number of prefetched zones, which were actually read.
+//
+uint64_t Machine::get_disk_prefetch_hits() const
+{
+    uint64_t count = 0;
+    for (auto &disk : disks) {
+        if (disk) {
+            count += disk->get_prefetch_hits();
+        }
+    }
+    return count;
+}
+
+//
+// Write changes kept in overlays to disk images.
+//
+void Machine::commit_disk_overlays()
+{
+    for (auto &disk : disks) {
+        if (disk) {
+            disk->commit_overlay();
+        }
+    }
+}
+
+//
+// Select when writes to disk images are flushed to storage.
+//
+void Machine::set_disk_sync(DiskSync policy, unsigned interval)
+{
+    if (policy == DiskSync::EVERY_N && interval == 0)
+        throw std::runtime_error("Bad disk sync interval");
+
+    disk_sync          = policy;
+    disk_sync_interval = interval;
+}
+
+//
+// Wait for pending writes to disk images, and flush them by the policy.
+//
+void Machine::sync_disks()
+{
+    // Every disk is synced, the first error is reported.
+    std::exception_ptr error;
+    for (auto &disk : disks) {
+        if (disk) {
+            try {
+                disk->sync();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
 }
 
 //
@@ -331,8 +674,8 @@ void Machine::map_drum_to_disk(unsigned drum, unsigned disk)
 {
     mapped_drum = drum;
     mapped_disk = disk;
-    std::cout << "Redirect drum " << to_octal(mapped_drum) << " to disk " << to_octal(mapped_disk)
-              << std::endl;
+    *output << "Redirect drum " << to_octal(mapped_drum) << " to disk " << to_octal(mapped_disk)
+            << std::endl;
 }
 
 //
@@ -26,7 +26,12 @@
 
 #include <array>
 #include <chrono>
+#include <deque>
+#include <fstream>
+#include <iostream>
 #include <memory>
+#include <sstream>
+#include <vector>
 
 #include "disk.h"
 #include "drum.h"
@@ -34,6 +39,15 @@
 #include "processor.h"
 
 class Machine {
+public:
+    // Execution engines.
+    enum class Engine {
+        STEP,     // reference: one instruction per call of Processor::step()
+        THREADED, // threaded dispatch, many instructions per call
+        BLOCK,    // threaded dispatch over superblocks of decoded instructions
+        JIT,      // superblocks translated into host code
+    };
+
 private:
     // Disks and drums.
     std::array<std::unique_ptr<Disk>, NDISKS> disks;
@@ -48,6 +62,9 @@ private:
     // Enable a progress message to stderr.
     bool progress_message_enabled{ false };
 
+    // Execution engine.
+    Engine engine{ Engine::BLOCK };
+
     // Every few seconds, print a message to stderr, to track the simulation progress.
     void show_progress();
 
@@ -64,21 +81,99 @@ private:
     // Path to disk images, semicolon separated.
     std::string disk_search_path;
 
-    // Trace output.
-    static std::ofstream trace_stream;
+    // Read-only disk images shared with other machines, when present.
+    std::shared_ptr<DiskCache> disk_cache;
+
+    // Zone records of disk images shared with other machines, when present.
+    std::shared_ptr<ZoneCache> zone_cache;
+
+    // Writable disks keep changes in overlay, over read-only image.
+    bool disk_overlay{};
+
+    // When writes to disk images are flushed to storage.
+    DiskSync disk_sync{ DiskSync::NONE };
+    unsigned disk_sync_interval{};
+
+    // Save snapshot to this file, when the monitor starts reading the job deck.
+    std::string snapshot_file;
+
+    // First read of the job deck from drum 1: repeated when starting from snapshot.
+    struct DeckRead {
+        unsigned zone, sector, addr, nwords;
+    } deck_read{};
+
+    // Printer output before the snapshot point: captured to be saved in snapshot,
+    // or restored from snapshot to be printed first.
+    std::ostringstream boot_capture;
+    std::ostream *job_output{};
+    std::string boot_printout;
+    void begin_boot_capture();
+    std::string end_boot_capture();
+    void flush_boot_capture();
+
+    // Stop when the monitor starts reading the job deck, see run_until_deck_read().
+    bool stop_at_deck{};
+
+    // Incremental checkpoints, see checkpoint.cpp.
+    // Pages and zones not modified since the previous checkpoint are shared with it.
+    using Page = std::array<Word, PAGE_NWORDS>;
+    struct Checkpoint {
+        uint64_t instr_count;  // instructions simulated so far
+        std::string cpu_state; // saved by Processor::save_state()
+        std::array<std::shared_ptr<const Page>, MEMORY_NWORDS / PAGE_NWORDS> pages;
+        std::array<std::array<std::shared_ptr<const Page>, Drum::NZONES>, NDRUMS> zones;
+    };
+    std::deque<Checkpoint> checkpoints;
+    uint64_t checkpoint_interval{}; // zero when disabled
+    uint64_t next_checkpoint{};
+    unsigned checkpoint_retain{};
+    void take_checkpoint();
+
+    // Output of the job: printer and operator console.
+    std::ostream *output{ &std::cout };
+
+    // Error messages and warnings.
+    std::ostream *error_output{ &std::cerr };
+
+    // Trace output: either a file opened by redirect_trace(),
+    // or a stream given by the caller. When none, trace goes to the output.
+    std::ofstream trace_file;
+    std::ostream *trace_stream{};
 
     // Trace modes.
-    static bool debug_instructions; // trace machine instuctions
-    static bool debug_extracodes;   // trace extracodes (except e75)
-    static bool debug_print;        // trace extracode e64
-    static bool debug_registers;    // trace CPU registers
-    static bool debug_memory;       // trace memory read/write
-    static bool debug_fetch;        // trace instruction fetch
+    bool debug_instructions{}; // trace machine instuctions
+    bool debug_extracodes{};   // trace extracodes (except e75)
+    bool debug_print{};        // trace extracode e64
+    bool debug_registers{};    // trace CPU registers
+    bool debug_memory{};       // trace memory read/write
+    bool debug_fetch{};        // trace instruction fetch
+
+    // Watchpoints on memory access: see add_watchpoint().
+    // Only pages marked in the masks take the slow path.
+    enum {
+        WATCH_READ  = 1, // memory read
+        WATCH_WRITE = 2, // memory write
+        WATCH_FETCH = 4, // instruction fetch
+        WATCH_STOP  = 8, // stop simulation on hit
+    };
+    struct Watchpoint {
+        unsigned addr, nwords, mode;
+    };
+    std::vector<Watchpoint> watchpoints;
+    uint32_t watch_read_pages{};
+    uint32_t watch_write_pages{};
+    uint32_t watch_fetch_pages{};
+    static bool page_watched(uint32_t mask, unsigned addr)
+    {
+        return (mask >> (addr / PAGE_NWORDS)) & 1;
+    }
+    void watch_access(unsigned mode, unsigned addr, Word val);
+
+    bool verbose{};                    // Verbose flag for tracing
+    uint64_t simulated_instructions{}; // Count of instructions
 
     // Static stuff.
-    static const uint64_t DEFAULT_LIMIT;    // Limit of instructions to simulate, by default
-    static bool verbose;                    // Verbose flag for tracing
-    static uint64_t simulated_instructions; // Count of instructions
+    static const uint64_t DEFAULT_LIMIT; // Limit of instructions to simulate, by default
 
 public:
     // 32K words of virtual memory.
@@ -103,51 +198,111 @@ public:
     // Enable a progress message to stderr.
     void enable_progress_message(bool on) { progress_message_enabled = on; }
 
+    // Select execution engine.
+    void set_engine(Engine e) { engine = e; }
+    Engine get_engine() const { return engine; }
+    static Engine engine_by_name(const std::string &name);
+
     // Get instruction count.
-    static uint64_t get_instr_count() { return simulated_instructions; }
-    static void incr_simulated_instructions() { simulated_instructions++; }
+    uint64_t get_instr_count() const { return simulated_instructions; }
+    void incr_simulated_instructions() { simulated_instructions++; }
+    void add_simulated_instructions(uint64_t n) { simulated_instructions += n; }
 
     // Limit the simulation to this number of instructions.
     void set_limit(uint64_t count) { instr_limit = count; }
     static uint64_t get_default_limit() { return DEFAULT_LIMIT; }
 
-    // Verbose flag for tracing.
-    static void set_verbose(bool on) { verbose = on; }
-    static bool get_verbose() { return verbose; }
-
-    // Enable trace output to the given file,
-    // or to std::cout when filename not present.
-    static void enable_trace(const char *mode);
-    static void redirect_trace(const char *file_name, const char *default_mode);
-    static void close_trace();
-    static bool trace_enabled()
+    // Verbose flag for tracing, and for statistics of the run.
+    void set_verbose(bool on)
+    {
+        verbose = on;
+        cpu.enable_fused_count(on);
+    }
+    bool get_verbose() const { return verbose; }
+
+    // Send output of the job to this stream, instead of std::cout.
+    void set_output(std::ostream &out) { output = &out; }
+    std::ostream &get_output() const { return *output; }
+
+    // Send error messages to this stream, instead of std::cerr.
+    void set_error_output(std::ostream &out) { error_output = &out; }
+    std::ostream &get_error_output() const { return *error_output; }
+
+    // Enable trace output to the given file or stream,
+    // or to the job output when filename not present.
+    void enable_trace(const char *mode);
+    void redirect_trace(const char *file_name, const char *default_mode);
+    void redirect_trace(std::ostream &out, const char *default_mode);
+    void close_trace();
+    bool trace_enabled() const
     {
         return debug_instructions | debug_extracodes | debug_print | debug_registers |
                debug_memory | debug_fetch;
     }
 
     // Emit trace to this stream.
-    static std::ostream &get_trace_stream();
+    std::ostream &get_trace_stream() const;
+
+    // Watch memory range, given as ADDR[:LEN][:MODE], in octal.
+    // Mode is any of r (read), w (write), x (fetch), and s to stop on hit.
+    // Default is one word, for write.
+    void add_watchpoint(const std::string &spec);
+    bool watching_reads() const { return watch_read_pages != 0; }
 
     // Memory access.
+    // Without TRACE, no trace checks: for untraced runs.
     Word mem_fetch(unsigned addr);
+    template <bool TRACE = true>
     Word mem_load(unsigned addr);
+    template <bool TRACE = true>
     void mem_store(unsigned addr, Word val);
 
     // Disk i/o.
     void disk_io(char op, unsigned disk_unit, unsigned zone, unsigned sector, unsigned addr,
                  unsigned nwords);
     void disk_mount(unsigned disk, const std::string &filename, bool write_permit);
+
+    // Statistics of disk read-ahead, for all units.
+    uint64_t get_disk_prefetch_count() const;
+    uint64_t get_disk_prefetch_hits() const;
     std::string disk_find(const std::string &filename);
 
+    // Share read-only disk images with other machines.
+    void set_disk_cache(std::shared_ptr<DiskCache> cache) { disk_cache = std::move(cache); }
+
+    // Read disk zones through the cache shared with other machines.
+    void set_zone_cache(std::shared_ptr<ZoneCache> cache) { zone_cache = std::move(cache); }
+    ZoneCache *get_zone_cache() const { return zone_cache.get(); }
+
+    // Statistics of the zone cache, for disks of this machine only.
+    ZoneCache::Stats get_zone_cache_stats() const;
+
+    // Mount writable disks with overlay: the image stays read-only and shared,
+    // modified zones are kept in memory. At the end, commit them to the image,
+    // or discard.
+    void set_disk_overlay(bool on) { disk_overlay = on; }
+    void commit_disk_overlays();
+
+    // Flush writes to disk images: never, at the end of job, or every so many writes.
+    // Must be called before disk_mount().
+    void set_disk_sync(DiskSync policy, unsigned interval = 0);
+
+    // At the end of job: wait for queued writes to disk images, and flush them
+    // when requested. Throw exception when any write failed.
+    void sync_disks();
+
     // Drum i/o.
     void drum_io(char op, unsigned drum_unit, unsigned zone, unsigned sector, unsigned addr,
                  unsigned nwords);
     void drum_init(unsigned drum_unit);
+    void drum_mount(unsigned drum_unit, const std::string &filename, bool write_permit);
     void drum_write_word(unsigned drum_unit, unsigned offset, Word value);
     Word drum_read_word(unsigned drum_unit, unsigned offset);
     void drum_write_cosy(unsigned drum_unit, unsigned &offset, const std::string &line);
 
+    // Occupancy of drums: zones allocated in all drums.
+    unsigned get_drum_zone_count() const;
+
     // "Phys.io": redirect drum r/w to disk.
     void map_drum_to_disk(unsigned drum, unsigned disk);
     unsigned get_mapped_disk() const { return mapped_disk; }
@@ -156,28 +311,57 @@ public:
     // Bootstrap the Monitoring System Dubna.
     void boot_ms_dubna();
 
+    // Snapshot of the booted monitor, see snapshot.cpp.
+    // Taken when the monitor reads the first page of the job deck from drum 1:
+    // all the state before that point doesn't depend on the job.
+    void set_snapshot_file(const std::string &filename) { snapshot_file = filename; }
+    void save_snapshot(const std::string &filename);
+    void restore_snapshot(const std::string &filename);
+
+    // Incremental checkpoints in memory: take one every so many instructions,
+    // keep the most recent ones. Roll back to any of them and run again.
+    void enable_checkpoints(uint64_t interval, unsigned retain);
+    unsigned get_checkpoint_count() const { return checkpoints.size(); }
+    uint64_t get_checkpoint_instr_count(unsigned index) const;
+    void rollback(unsigned index);
+
+    // Pre-boot for fork server: run the monitor until it reads the job deck.
+    // Later, in a child process, load the deck, repeat the read and continue.
+    void run_until_deck_read();
+    void reread_deck();
+
     //
     // Trace methods.
     //
-    static void trace_exception(const char *message)
+    void trace_exception(const char *message)
     {
         if (trace_enabled())
             print_exception(message);
     }
 
-    static void trace_fetch(unsigned addr, Word val)
+    void trace_fetch(unsigned addr, Word val)
     {
         if (debug_fetch)
             print_fetch(addr, val);
+        if (page_watched(watch_fetch_pages, addr))
+            watch_access(WATCH_FETCH, addr, val);
     }
 
-    static void trace_memory_write(unsigned addr, Word val)
+    void trace_fetch(unsigned addr)
+    {
+        if (debug_fetch)
+            print_fetch(addr, memory.load(addr));
+        if (page_watched(watch_fetch_pages, addr))
+            watch_access(WATCH_FETCH, addr, memory.load(addr));
+    }
+
+    void trace_memory_write(unsigned addr, Word val)
     {
         if (debug_memory)
             print_memory_access(addr, val, "Write");
     }
 
-    static void trace_memory_read(unsigned addr, Word val)
+    void trace_memory_read(unsigned addr, Word val)
     {
         if (debug_memory)
             print_memory_access(addr, val, "Read");
@@ -208,11 +392,49 @@ public:
             print_e64(info, start_addr, end_addr);
     }
 
-    static void print_exception(const char *message);
-    static void print_fetch(unsigned addr, Word val);
-    static void print_memory_access(unsigned addr, Word val, const char *opname);
-    static void print_e70(const E70_Info &info);
+    void print_exception(const char *message);
+    void print_fetch(unsigned addr, Word val);
+    void print_memory_access(unsigned addr, Word val, const char *opname);
+    void print_watch(unsigned addr, Word val, const char *opname, unsigned pc, bool right);
+    void print_e70(const E70_Info &info);
     void print_e64(const E64_Info &info, unsigned start_addr, unsigned end_addr);
 };
 
+//
+// Write word to memory.
+//
+template <bool TRACE>
+inline void Machine::mem_store(unsigned addr, Word val)
+{
+    addr &= BITS(15);
+    if (addr == 0)
+        return;
+
+    memory.store(addr, val);
+    cpu.invalidate(addr);
+    if (TRACE)
+        trace_memory_write(addr, val);
+    if (page_watched(watch_write_pages, addr))
+        watch_access(WATCH_WRITE, addr, val);
+}
+
+//
+// Read word from memory.
+//
+template <bool TRACE>
+inline Word Machine::mem_load(unsigned addr)
+{
+    addr &= BITS(15);
+    if (addr == 0)
+        return 0;
+
+    Word val = memory.load(addr);
+    if (TRACE)
+        trace_memory_read(addr, val);
+    if (page_watched(watch_read_pages, addr))
+        watch_access(WATCH_READ, addr, val);
+
+    return val & BITS48;
+}
+
 #endif // DUBNA_MACHINE_H
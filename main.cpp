@@ -24,6 +24,7 @@
 #include <cstring>
 #include <iostream>
 
+#include "batch.h"
 #include "session.h"
 
 //
@@ -37,10 +38,52 @@ static const struct option long_options[] = {
     { "limit",      required_argument,  nullptr,    'l' },
     { "trace",      required_argument,  nullptr,    'T' },
     { "debug",      required_argument,  nullptr,    'd' },
+    { "engine",     required_argument,  nullptr,    'E' },
+    { "batch",      no_argument,        nullptr,    'B' },
+    { "jobs",       required_argument,  nullptr,    'j' },
+    { "save-snapshot", required_argument, nullptr,  'S' },
+    { "from-snapshot", required_argument, nullptr,  'F' },
+    { "server",     required_argument,  nullptr,    'D' },
+    { "watch",      required_argument,  nullptr,    'W' },
+    { "drum",       required_argument,  nullptr,    'M' },
+    { "disk",       required_argument,  nullptr,    'K' },
+    { "disk-overlay", required_argument, nullptr,   'O' },
+    { "zone-cache", required_argument,  nullptr,    'Z' },
+    { "disk-sync",  required_argument,  nullptr,    'Y' },
     { nullptr },
     // clang-format on
 };
 
+//
+// Drum or disk to mount.
+//
+struct Mount {
+    bool disk;
+    unsigned unit;
+    std::string filename;
+    bool write_permit;
+};
+
+//
+// Parse mount option: UNIT:FILE[:ro], unit in octal.
+// Return false on error.
+//
+static bool parse_mount(const std::string &arg, Mount &mount)
+{
+    std::string spec = arg;
+    if (spec.size() > 3 && spec.compare(spec.size() - 3, 3, ":ro") == 0) {
+        spec.resize(spec.size() - 3);
+        mount.write_permit = false;
+    }
+    char *end;
+    mount.unit = std::strtoul(spec.c_str(), &end, 8);
+    if (end == spec.c_str() || *end != ':' || end[1] == 0) {
+        return false;
+    }
+    mount.filename = end + 1;
+    return true;
+}
+
 //
 // Print usage message.
 //
@@ -49,8 +92,11 @@ static void print_usage(std::ostream &out, const char *prog_name)
     out << "Dubna Simulator, Version " << Session::get_version() << "\n";
     out << "Usage:" << std::endl;
     out << "    " << prog_name << " [options...] filename" << std::endl;
+    out << "    " << prog_name << " --batch [-j NUM] [options...] filename..." << std::endl;
     out << "Input files:" << std::endl;
     out << "    filename                Job file in MS Dubna format" << std::endl;
+    out << "    directory               In batch mode: all *.dub files in directory" << std::endl;
+    out << "    @manifest               In batch mode: job files listed one per line" << std::endl;
     out << "Options:" << std::endl;
     out << "    -h, --help              Display available options" << std::endl;
     out << "    -V, --version           Print the version number and exit" << std::endl;
@@ -60,6 +106,30 @@ static void print_usage(std::ostream &out, const char *prog_name)
     out << "    -t                      Trace extracodes to stdout" << std::endl;
     out << "    --trace=FILE            Redirect trace to the file" << std::endl;
     out << "    -d MODE, --debug=MODE   Select debug mode, default irm" << std::endl;
+    out << "    --engine=NAME           Select execution engine, default block" << std::endl;
+    out << "    --drum=UNIT:FILE[:ro]   Map drum unit (octal) from the file, optionally read only"
+        << std::endl;
+    out << "    --disk=UNIT:FILE[:ro]   Mount disk image as unit 30-67 (octal)" << std::endl;
+    out << "    --disk-overlay=MODE     Keep changes of writable disks in memory, then"
+        << std::endl;
+    out << "                            commit them to the images or discard" << std::endl;
+    out << "    --disk-sync=MODE        Flush writes to disk images: none (default), end of job,"
+        << std::endl;
+    out << "                            or every NUM writes" << std::endl;
+    out << "    --zone-cache=MBYTES     Cache disk zones in memory, shared by batch jobs"
+        << std::endl;
+    out << "    --watch=ADDR[:LEN][:MODE]" << std::endl;
+    out << "                            Log access to memory range to the trace, in octal"
+        << std::endl;
+    out << "    --batch                 Run many jobs, write output to name.out" << std::endl;
+    out << "                            and exit status to name.status" << std::endl;
+    out << "    -j NUM, --jobs=NUM      Number of worker threads in batch mode, 0 for all CPUs"
+        << std::endl;
+    out << "    --save-snapshot=FILE    Save state of the booted monitor to the file" << std::endl;
+    out << "    --from-snapshot=FILE    Start from the saved state, skip the boot" << std::endl;
+    out << "    --server=SOCKET         Boot once, then run jobs received on the UNIX socket,"
+        << std::endl;
+    out << "                            for example: nc -U -N SOCKET < job.dub" << std::endl;
     out << "Debug modes:" << std::endl;
     out << "    i       Trace instructions" << std::endl;
     out << "    e       Trace extracodes" << std::endl;
@@ -67,6 +137,16 @@ static void print_usage(std::ostream &out, const char *prog_name)
     out << "    f       Trace fetch" << std::endl;
     out << "    r       Trace registers" << std::endl;
     out << "    m       Trace memory read/write" << std::endl;
+    out << "Watch modes:" << std::endl;
+    out << "    r       Watch memory read" << std::endl;
+    out << "    w       Watch memory write, default" << std::endl;
+    out << "    x       Watch instruction fetch" << std::endl;
+    out << "    s       Stop simulation on hit" << std::endl;
+    out << "Engines:" << std::endl;
+    out << "    jit         Superblocks translated into x86-64 code" << std::endl;
+    out << "    block       Threaded dispatch over superblocks, fastest" << std::endl;
+    out << "    threaded    Threaded dispatch, fast" << std::endl;
+    out << "    step        One instruction at a time, for reference" << std::endl;
 }
 
 //
@@ -85,10 +165,17 @@ int main(int argc, char *argv[])
 
     // Instantiate the session.
     Session session;
+    Batch batch;
+    bool batch_mode = false;
+    std::string server_socket;
+    std::vector<std::string> job_files;
+    std::vector<Mount> mounts;
+    std::string no_batch_option; // option which cannot be used in batch mode
 
     // Parse command line options.
     for (;;) {
-        switch (getopt_long(argc, argv, "-hVvl:tT:d:", long_options, nullptr)) {
+        int c = getopt_long(argc, argv, "-hVvl:tT:d:j:", long_options, nullptr);
+        switch (c) {
         case EOF:
             break;
 
@@ -97,7 +184,7 @@ int main(int argc, char *argv[])
 
         case 1:
             // Regular argument.
-            session.set_job_file(optarg);
+            job_files.push_back(optarg);
             continue;
 
         case 'h':
@@ -108,6 +195,7 @@ int main(int argc, char *argv[])
         case 'v':
             // Verbose.
             session.set_verbose(true);
+            batch.set_verbose(true);
             continue;
 
         case 'V':
@@ -119,6 +207,7 @@ int main(int argc, char *argv[])
             // Limit the cycle count.
             try {
                 session.set_limit(std::stoull(optarg));
+                batch.set_limit(std::stoull(optarg));
             } catch (...) {
                 std::cerr << "Bad --limit option: " << optarg << std::endl;
                 print_usage(std::cerr, prog_name);
@@ -129,16 +218,128 @@ int main(int argc, char *argv[])
         case 't':
             // Enable tracing of extracodes, to stdout by default.
             session.enable_trace("e");
+            batch.enable_trace("e");
             continue;
 
         case 'T':
             // Redirect tracing to a file.
             session.set_trace_file(optarg, "irm");
+            no_batch_option = "--trace";
             continue;
 
         case 'd':
             // Set trace options.
             session.enable_trace(optarg);
+            batch.enable_trace(optarg);
+            continue;
+
+        case 'E':
+            // Select execution engine.
+            try {
+                session.set_engine(optarg);
+                batch.set_engine(optarg);
+            } catch (...) {
+                std::cerr << "Bad --engine option: " << optarg << std::endl;
+                print_usage(std::cerr, prog_name);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+
+        case 'W':
+            // Watch memory range.
+            try {
+                session.add_watchpoint(optarg);
+                batch.add_watchpoint(optarg);
+            } catch (...) {
+                std::cerr << "Bad --watch option: " << optarg << std::endl;
+                print_usage(std::cerr, prog_name);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+
+        case 'M':
+        case 'K':
+            // Map drum from file, or mount disk image.
+            mounts.push_back({ c == 'K', 0, "", true });
+            if (!parse_mount(optarg, mounts.back())) {
+                std::cerr << "Bad " << (c == 'K' ? "--disk" : "--drum") << " option: " << optarg
+                          << std::endl;
+                print_usage(std::cerr, prog_name);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+
+        case 'O':
+            // Overlay for writable disks.
+            if (strcmp(optarg, "commit") == 0) {
+                session.enable_disk_overlay(true);
+                batch.enable_disk_overlay(true);
+            } else if (strcmp(optarg, "discard") == 0) {
+                session.enable_disk_overlay(false);
+                batch.enable_disk_overlay(false);
+            } else {
+                std::cerr << "Bad --disk-overlay option: " << optarg << std::endl;
+                print_usage(std::cerr, prog_name);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+
+        case 'Y':
+            // Flush policy for writable disks.
+            try {
+                session.set_disk_sync(optarg);
+                batch.set_disk_sync(optarg);
+            } catch (...) {
+                std::cerr << "Bad --disk-sync option: " << optarg << std::endl;
+                print_usage(std::cerr, prog_name);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+
+        case 'Z':
+            // Cache of disk zones.
+            try {
+                size_t nbytes = std::stoul(optarg) << 20;
+                session.enable_zone_cache(nbytes);
+                batch.enable_zone_cache(nbytes);
+            } catch (...) {
+                std::cerr << "Bad --zone-cache option: " << optarg << std::endl;
+                print_usage(std::cerr, prog_name);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+
+        case 'S':
+            // Save snapshot of the booted monitor.
+            session.save_snapshot(optarg);
+            no_batch_option = "--save-snapshot";
+            continue;
+
+        case 'F':
+            // Start from snapshot.
+            session.start_from_snapshot(optarg);
+            batch.start_from_snapshot(optarg);
+            continue;
+
+        case 'D':
+            // Run as fork server.
+            server_socket = optarg;
+            continue;
+
+        case 'B':
+            // Run many jobs in parallel.
+            batch_mode = true;
+            continue;
+
+        case 'j':
+            // Number of worker threads.
+            try {
+                batch.set_workers(std::stoul(optarg));
+            } catch (...) {
+                std::cerr << "Bad --jobs option: " << optarg << std::endl;
+                print_usage(std::cerr, prog_name);
+                exit(EXIT_FAILURE);
+            }
             continue;
 
         default:
@@ -148,7 +349,59 @@ int main(int argc, char *argv[])
         break;
     }
 
+    if (batch_mode && !no_batch_option.empty()) {
+        std::cerr << "Option " << no_batch_option << " cannot be used with --batch" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Mount drums and disks, when all options are known.
+    // In batch mode, every job mounts them in its own session.
+    if (batch_mode) {
+        for (auto &mount : mounts) {
+            batch.add_mount(mount.disk, mount.unit, mount.filename, mount.write_permit);
+        }
+        mounts.clear();
+    }
+    try {
+        for (auto &mount : mounts) {
+            if (mount.disk) {
+                session.disk_mount(mount.unit, mount.filename, mount.write_permit);
+            } else {
+                session.drum_mount(mount.unit, mount.filename, mount.write_permit);
+            }
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!server_socket.empty()) {
+        // Serve jobs until killed.
+        session.serve(server_socket);
+        return session.get_exit_status();
+    }
+
+    if (batch_mode) {
+        // Run all jobs on worker threads.
+        try {
+            for (auto &name : job_files) {
+                batch.add_jobs(name);
+            }
+        } catch (const std::exception &ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (batch.get_job_count() == 0) {
+            print_usage(std::cerr, prog_name);
+            exit(EXIT_FAILURE);
+        }
+        return batch.run(std::cout);
+    }
+
     // Must specify a file to run.
+    for (auto &name : job_files) {
+        session.set_job_file(name);
+    }
     if (session.get_job_file().empty()) {
         print_usage(std::cerr, prog_name);
         exit(EXIT_FAILURE);
@@ -48,6 +48,7 @@ void Memory::write_words(const Words &input, unsigned addr)
 {
     unsigned nwords = input.size();
     memcpy(&mem[addr], input.data(), nwords * sizeof(Word));
+    mark_dirty(addr, nwords);
 }
 
 //
@@ -64,6 +65,22 @@ void Memory::read_words(Word output[], unsigned nwords, unsigned addr)
 void Memory::write_words(const Word input[], unsigned nwords, unsigned addr)
 {
     memcpy(&mem[addr], input, nwords * sizeof(Word));
+    mark_dirty(addr, nwords);
+}
+
+//
+// Mark pages in the given range as modified.
+//
+void Memory::mark_dirty(unsigned addr, unsigned nwords)
+{
+    if (nwords == 0)
+        return;
+
+    unsigned first = addr / PAGE_NWORDS;
+    unsigned last  = (addr + nwords - 1) / PAGE_NWORDS;
+    for (unsigned page = first; page <= last; page++) {
+        dirty_pages |= 1u << page;
+    }
 }
 
 //
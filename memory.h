@@ -33,12 +33,20 @@ private:
     // Memory contents.
     std::array<Word, MEMORY_NWORDS> mem;
 
+    // Pages modified since last clear_dirty_pages(), one bit per page.
+    uint32_t dirty_pages{};
+    static_assert(MEMORY_NWORDS / PAGE_NWORDS <= 32, "Too many pages for dirty mask");
+
 public:
     explicit Memory() = default;
     virtual ~Memory() = default;
 
     // Store data to memory.
-    void store(unsigned addr, Word val) { mem[addr] = val; }
+    void store(unsigned addr, Word val)
+    {
+        mem[addr] = val;
+        dirty_pages |= 1u << (addr / PAGE_NWORDS);
+    }
 
     // Load data from memory.
     Word load(unsigned addr) { return mem[addr]; }
@@ -50,6 +58,13 @@ public:
     void read_words(Word output[], unsigned nwords, unsigned addr);
     Word *get_ptr(unsigned addr) { return &mem[addr]; }
 
+    // Dirty pages: modified by store(), write_words(), or marked by mark_dirty()
+    // after a write through get_ptr().
+    void mark_dirty(unsigned addr, unsigned nwords);
+    uint32_t get_dirty_pages() const { return dirty_pages; }
+    bool is_page_dirty(unsigned page) const { return (dirty_pages >> page) & 1; }
+    void clear_dirty_pages(uint32_t mask = ~0u) { dirty_pages &= ~mask; }
+
     // Dump disk data for debug.
     void dump(unsigned serial_num, unsigned disk_unit, unsigned zone, unsigned sector,
               unsigned addr, unsigned nwords);
@@ -21,8 +21,18 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 //
+#include "jit.h"
 #include "machine.h"
 
+//
+// Hot paths of the threaded engine must be inlined into every handler.
+//
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
 //
 // Initialize the processor.
 //
@@ -31,6 +41,11 @@ Processor::Processor(Machine &mach, Memory &mem) : machine(mach), memory(mem)
     reset();
 }
 
+//
+// Release translated code.
+//
+Processor::~Processor() = default;
+
 //
 // Finish the processor
 //
@@ -48,6 +63,18 @@ void Processor::reset()
     core    = {};
     core.PC = 1;
 
+    // Forget all decoded instructions and superblocks.
+    decoded.assign(2 * MEMORY_NWORDS, {});
+    block_map.assign(2 * MEMORY_NWORDS, {});
+    for (auto &list : page_blocks) {
+        list.clear();
+    }
+    block_words.assign(MEMORY_NWORDS, 0);
+    dirty_pages = 0;
+    if (jit) {
+        jit->reset();
+    }
+
     machine.trace_exception("Reset");
 }
 
@@ -61,564 +88,695 @@ void Processor::stack_correction()
 }
 
 //
-// Execute one instruction, placed at address PC+right_instr_flag.
-// Return false to continue the program.
-// Return true when the program is done and the processor is stopped.
-// Emit exception in case of failure.
+// Default handler: extracodes and invalid opcodes.
 //
-bool Processor::step()
+template <bool TRACE, unsigned OPCODE>
+void Processor::execute(Opcode<OPCODE>, unsigned reg, unsigned addr)
 {
-    unsigned reg, opcode, addr, nextpc, next_mod;
-    Word word;
-
-    corr_stack = 0;
-    core.PC &= BITS(15);
-    word = machine.mem_fetch(core.PC);
-    if (core.right_instr_flag)
-        RK = (unsigned)word;         // get right instruction
-    else
-        RK = (unsigned)(word >> 24); // get left instruction
-
-    RK &= BITS(24);
-
-    reg = RK >> 20;
-    if (RK & ONEBIT(20)) {
-        addr   = RK & BITS(15);
-        opcode = (RK >> 12) & 0370;
+    if constexpr ((OPCODE >= 050 && OPCODE <= 077) || OPCODE == 0200 || OPCODE == 0210) {
+        // э50...э77, э20, э21
+        Aex        = ADDR(addr + core.M[reg]);
+        core.M[14] = Aex;
+        extracode(OPCODE);
+        core.set_logical();
     } else {
-        addr = RK & BITS(12);
-        if (RK & ONEBIT(19))
-            addr |= 070000;
-        opcode = (RK >> 12) & 077;
+        // Unknown instruction - cannot happen.
+        throw Exception("Unknown instruction");
     }
+}
 
-    // Show instruction: address, opcode and mnemonics.
-    machine.trace_instruction(opcode);
-
-    nextpc = ADDR(core.PC + 1);
-    if (core.right_instr_flag) {
-        core.PC += 1; // increment PC
-        core.right_instr_flag = false;
+//
+// Get operand of memory-reference instruction, and compute executive address.
+// Stack form pops the operand: M[017] is restored on exception.
+// Register M[0] is always zero.
+//
+template <bool TRACE, AddrMode MODE>
+ALWAYS_INLINE Word Processor::load_operand(unsigned reg, unsigned addr)
+{
+    if constexpr (MODE == AddrMode::GENERIC) {
+        if (!addr && reg == 017) {
+            return load_operand<TRACE, AddrMode::STACK>(reg, addr);
+        }
+        return load_operand<TRACE, AddrMode::INDEX>(reg, addr);
     } else {
-        core.right_instr_flag = true;
+        if constexpr (MODE == AddrMode::STACK) {
+            core.M[017] = ADDR(core.M[017] - 1);
+            corr_stack  = 1;
+            Aex         = core.M[017];
+        } else if constexpr (MODE == AddrMode::DIRECT) {
+            Aex = addr;
+        } else {
+            Aex = ADDR(addr + core.M[reg]);
+        }
+        return machine.mem_load<TRACE>(Aex);
     }
+}
 
-    if (core.apply_mod_reg) {
-        addr = ADDR(addr + core.MOD);
+//
+// Execute instruction by dispatch entry: opcode,
+// or specialized handler of memory-reference opcode.
+//
+template <bool TRACE, unsigned ENTRY>
+ALWAYS_INLINE void Processor::execute_entry(unsigned reg, unsigned addr)
+{
+    if constexpr (ENTRY >= ENTRY_BASE && ENTRY < ENTRY_BASE + 3 * MEMORY_NCODES) {
+        constexpr unsigned mode   = (ENTRY - ENTRY_BASE) / MEMORY_NCODES + 1;
+        constexpr unsigned opcode = (ENTRY - ENTRY_BASE) % MEMORY_NCODES + MEMORY_FIRST;
+        execute<TRACE, AddrMode(mode)>(Opcode<opcode>(), reg, addr);
+    } else if constexpr (ENTRY == ENTRY_PAIR_UTC) {
+        execute<TRACE>(Opcode<0220>(), reg, addr);
+    } else if constexpr (ENTRY == ENTRY_PAIR_WTC) {
+        execute<TRACE>(Opcode<0230>(), reg, addr);
+    } else {
+        execute<TRACE>(Opcode<ENTRY>(), reg, addr);
     }
-    next_mod = 0;
+}
 
-    switch (opcode) {
-    case 000: // зп, atx
-        Aex = ADDR(addr + core.M[reg]);
-        machine.mem_store(Aex, core.ACC);
-        if (!addr && reg == 017)
-            core.M[017] = ADDR(core.M[017] + 1);
-        break;
-
-    case 001: // зпм, stx
-        Aex = ADDR(addr + core.M[reg]);
-        machine.mem_store(Aex, core.ACC);
-        core.M[017] = ADDR(core.M[017] - 1);
-        corr_stack  = 1;
-        core.ACC    = machine.mem_load(core.M[017]);
-        core.set_logical();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<000>, unsigned reg, unsigned addr) // зп, atx
+{
+    Aex = ADDR(addr + core.M[reg]);
+    machine.mem_store<TRACE>(Aex, core.ACC);
+    if (!addr && reg == 017)
+        core.M[017] = ADDR(core.M[017] + 1);
+}
 
-    case 002: // рег, mod
-        throw Exception("Illegal instruction 002 рег/mod");
+template <bool TRACE>
+void Processor::execute(Opcode<001>, unsigned reg, unsigned addr) // зпм, stx
+{
+    Aex = ADDR(addr + core.M[reg]);
+    machine.mem_store<TRACE>(Aex, core.ACC);
+    core.M[017] = ADDR(core.M[017] - 1);
+    corr_stack  = 1;
+    core.ACC    = machine.mem_load<TRACE>(core.M[017]);
+    core.set_logical();
+}
 
-    case 003: // счм, xts
-        machine.mem_store(core.M[017], core.ACC);
-        core.M[017] = ADDR(core.M[017] + 1);
-        corr_stack  = -1;
-        Aex         = ADDR(addr + core.M[reg]);
-        core.ACC    = machine.mem_load(Aex);
-        core.set_logical();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<002>, unsigned, unsigned) // рег, mod
+{
+    throw Exception("Illegal instruction 002 рег/mod");
+}
 
-    case 004: // сл, a+x
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add(machine.mem_load(Aex), 0, 0);
-        core.set_additive();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<003>, unsigned reg, unsigned addr) // счм, xts
+{
+    machine.mem_store<TRACE>(core.M[017], core.ACC);
+    core.M[017] = ADDR(core.M[017] + 1);
+    corr_stack  = -1;
+    Aex         = ADDR(addr + core.M[reg]);
+    core.ACC    = machine.mem_load<TRACE>(Aex);
+    core.set_logical();
+}
 
-    case 005: // вч, a-x
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add(machine.mem_load(Aex), 0, 1);
-        core.set_additive();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<004>, unsigned reg, unsigned addr) // сл, a+x
+{
+    arith_add(load_operand<TRACE, MODE>(reg, addr), 0, 0);
+    core.set_additive();
+}
 
-    case 006: // вчоб, x-a
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add(machine.mem_load(Aex), 1, 0);
-        core.set_additive();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<005>, unsigned reg, unsigned addr) // вч, a-x
+{
+    arith_add(load_operand<TRACE, MODE>(reg, addr), 0, 1);
+    core.set_additive();
+}
 
-    case 007: // вчаб, amx
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add(machine.mem_load(Aex), 1, 1);
-        core.set_additive();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<006>, unsigned reg, unsigned addr) // вчоб, x-a
+{
+    arith_add(load_operand<TRACE, MODE>(reg, addr), 1, 0);
+    core.set_additive();
+}
 
-    case 010: // сч, xta
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex      = ADDR(addr + core.M[reg]);
-        core.ACC = machine.mem_load(Aex);
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<007>, unsigned reg, unsigned addr) // вчаб, amx
+{
+    arith_add(load_operand<TRACE, MODE>(reg, addr), 1, 1);
+    core.set_additive();
+}
 
-    case 011: // и, aax
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        core.ACC &= machine.mem_load(Aex);
-        core.RMR = 0;
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<010>, unsigned reg, unsigned addr) // сч, xta
+{
+    core.ACC = load_operand<TRACE, MODE>(reg, addr);
+    core.set_logical();
+}
 
-    case 012: // нтж, aex
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex      = ADDR(addr + core.M[reg]);
-        core.RMR = core.ACC;
-        core.ACC ^= machine.mem_load(Aex);
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<011>, unsigned reg, unsigned addr) // и, aax
+{
+    core.ACC &= load_operand<TRACE, MODE>(reg, addr);
+    core.RMR = 0;
+    core.set_logical();
+}
 
-    case 013: // слц, arx
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        core.ACC += machine.mem_load(Aex);
-        if (core.ACC & ONEBIT(49))
-            core.ACC = (core.ACC + 1) & BITS48;
-        core.RMR = 0;
-        core.set_multiplicative();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<012>, unsigned reg, unsigned addr) // нтж, aex
+{
+    core.RMR = core.ACC;
+    core.ACC ^= load_operand<TRACE, MODE>(reg, addr);
+    core.set_logical();
+}
 
-    case 014: // знак, avx
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_change_sign(machine.mem_load(Aex) >> 40 & 1);
-        core.set_additive();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<013>, unsigned reg, unsigned addr) // слц, arx
+{
+    core.ACC += load_operand<TRACE, MODE>(reg, addr);
+    if (core.ACC & ONEBIT(49))
+        core.ACC = (core.ACC + 1) & BITS48;
+    core.RMR = 0;
+    core.set_multiplicative();
+}
 
-    case 015: // или, aox
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        core.ACC |= machine.mem_load(Aex);
-        core.RMR = 0;
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<014>, unsigned reg, unsigned addr) // знак, avx
+{
+    arith_change_sign(load_operand<TRACE, MODE>(reg, addr) >> 40 & 1);
+    core.set_additive();
+}
 
-    case 016: // дел, a/x
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_divide(machine.mem_load(Aex));
-        core.set_multiplicative();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<015>, unsigned reg, unsigned addr) // или, aox
+{
+    core.ACC |= load_operand<TRACE, MODE>(reg, addr);
+    core.RMR = 0;
+    core.set_logical();
+}
 
-    case 017: // умн, a*x
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_multiply(machine.mem_load(Aex));
-        core.set_multiplicative();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<016>, unsigned reg, unsigned addr) // дел, a/x
+{
+    arith_divide(load_operand<TRACE, MODE>(reg, addr));
+    core.set_multiplicative();
+}
 
-    case 020: // сбр, apx
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex      = ADDR(addr + core.M[reg]);
-        core.ACC = besm6_pack(core.ACC, machine.mem_load(Aex));
-        core.RMR = 0;
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<017>, unsigned reg, unsigned addr) // умн, a*x
+{
+    arith_multiply(load_operand<TRACE, MODE>(reg, addr));
+    core.set_multiplicative();
+}
 
-    case 021: // рзб, aux
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex      = ADDR(addr + core.M[reg]);
-        core.ACC = besm6_unpack(core.ACC, machine.mem_load(Aex));
-        core.RMR = 0;
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<020>, unsigned reg, unsigned addr) // сбр, apx
+{
+    core.ACC = besm6_pack(core.ACC, load_operand<TRACE, MODE>(reg, addr));
+    core.RMR = 0;
+    core.set_logical();
+}
 
-    case 022: // чед, acx
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex      = ADDR(addr + core.M[reg]);
-        core.ACC = besm6_count_ones(core.ACC) + machine.mem_load(Aex);
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<021>, unsigned reg, unsigned addr) // рзб, aux
+{
+    core.ACC = besm6_unpack(core.ACC, load_operand<TRACE, MODE>(reg, addr));
+    core.RMR = 0;
+    core.set_logical();
+}
+
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<022>, unsigned reg, unsigned addr) // чед, acx
+{
+    core.ACC = besm6_count_ones(core.ACC) + load_operand<TRACE, MODE>(reg, addr);
+    if (core.ACC & ONEBIT(49))
+        core.ACC = (core.ACC + 1) & BITS48;
+    core.RMR = 0;
+    core.set_logical();
+}
+
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<023>, unsigned reg, unsigned addr) // нед, anx
+{
+    if (core.ACC) {
+        int n = besm6_highest_bit(core.ACC);
+
+        // "Остаток" сумматора, исключая бит,
+        // номер которого определен, помещается в РМР,
+        // начиная со старшего бита РМР.
+        arith_shift(48 - n);
+
+        // Циклическое сложение номера со словом по Аисп.
+        core.ACC = n + load_operand<TRACE, MODE>(reg, addr);
         if (core.ACC & ONEBIT(49))
             core.ACC = (core.ACC + 1) & BITS48;
+    } else {
         core.RMR = 0;
-        core.set_logical();
-        break;
+        core.ACC = load_operand<TRACE, MODE>(reg, addr);
+    }
+    core.set_logical();
+}
 
-    case 023: // нед, anx
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        if (core.ACC) {
-            int n = besm6_highest_bit(core.ACC);
-
-            // "Остаток" сумматора, исключая бит,
-            // номер которого определен, помещается в РМР,
-            // начиная со старшего бита РМР.
-            arith_shift(48 - n);
-
-            // Циклическое сложение номера со словом по Аисп.
-            core.ACC = n + machine.mem_load(Aex);
-            if (core.ACC & ONEBIT(49))
-                core.ACC = (core.ACC + 1) & BITS48;
-        } else {
-            core.RMR = 0;
-            core.ACC = machine.mem_load(Aex);
-        }
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<024>, unsigned reg, unsigned addr) // слп, e+x
+{
+    arith_add_exponent((load_operand<TRACE, MODE>(reg, addr) >> 41) - 64);
+    core.set_multiplicative();
+}
 
-    case 024: // слп, e+x
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add_exponent((machine.mem_load(Aex) >> 41) - 64);
-        core.set_multiplicative();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<025>, unsigned reg, unsigned addr) // вчп, e-x
+{
+    arith_add_exponent(64 - (load_operand<TRACE, MODE>(reg, addr) >> 41));
+    core.set_multiplicative();
+}
 
-    case 025: // вчп, e-x
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add_exponent(64 - (machine.mem_load(Aex) >> 41));
-        core.set_multiplicative();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<026>, unsigned reg, unsigned addr) // сд, asx
+{
+    int n = (load_operand<TRACE, MODE>(reg, addr) >> 41) - 64;
+    arith_shift(n);
+    core.set_logical();
+}
 
-    case 026: { // сд, asx
-        int n;
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex = ADDR(addr + core.M[reg]);
-        n   = (machine.mem_load(Aex) >> 41) - 64;
-        arith_shift(n);
-        core.set_logical();
-        break;
+template <bool TRACE, AddrMode MODE>
+void Processor::execute(Opcode<027>, unsigned reg, unsigned addr) // рж, xtr
+{
+    core.RAU = (load_operand<TRACE, MODE>(reg, addr) >> 41) & 077;
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<030>, unsigned reg, unsigned addr) // счрж, rte
+{
+    Aex      = ADDR(addr + core.M[reg]);
+    core.ACC = (Word)(core.RAU & Aex & 0177) << 41;
+    core.set_logical();
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<031>, unsigned reg, unsigned addr) // счмр, yta
+{
+    Aex = ADDR(addr + core.M[reg]);
+    if (core.is_logical()) {
+        core.ACC = core.RMR;
+    } else {
+        Word x   = core.RMR;
+        core.ACC = (core.ACC & ~BITS41) | (core.RMR & BITS40);
+        arith_add_exponent((Aex & 0177) - 64);
+        core.RMR = x;
     }
+}
 
-    case 027: // рж, xtr
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex      = ADDR(addr + core.M[reg]);
-        core.RAU = (machine.mem_load(Aex) >> 41) & 077;
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<032>, unsigned, unsigned) // зпп, запись полноразрядная
+{
+    throw Exception("Illegal instruction 032 зпп");
+}
 
-    case 030: // счрж, rte
-        Aex      = ADDR(addr + core.M[reg]);
-        core.ACC = (Word)(core.RAU & Aex & 0177) << 41;
-        core.set_logical();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<033>, unsigned, unsigned) // счп, считывание полноразрядное
+{
+    throw Exception("Illegal instruction 033 счп");
+}
 
-    case 031: // счмр, yta
-        Aex = ADDR(addr + core.M[reg]);
-        if (core.is_logical()) {
-            core.ACC = core.RMR;
-        } else {
-            Word x   = core.RMR;
-            core.ACC = (core.ACC & ~BITS41) | (core.RMR & BITS40);
-            arith_add_exponent((Aex & 0177) - 64);
-            core.RMR = x;
-        }
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<034>, unsigned reg, unsigned addr) // слпа, e+n
+{
+    Aex = ADDR(addr + core.M[reg]);
+    arith_add_exponent((Aex & 0177) - 64);
+    core.set_multiplicative();
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<035>, unsigned reg, unsigned addr) // вчпа, e-n
+{
+    Aex = ADDR(addr + core.M[reg]);
+    arith_add_exponent(64 - (Aex & 0177));
+    core.set_multiplicative();
+}
 
-    case 032: // зпп, запись полноразрядная
-        throw Exception("Illegal instruction 032 зпп");
+template <bool TRACE>
+void Processor::execute(Opcode<036>, unsigned reg, unsigned addr) // сда, asn
+{
+    int n;
+    Aex = ADDR(addr + core.M[reg]);
+    n   = (Aex & 0177) - 64;
+    arith_shift(n);
+    core.set_logical();
+}
 
-    case 033: // счп, считывание полноразрядное
-        throw Exception("Illegal instruction 033 счп");
+template <bool TRACE>
+void Processor::execute(Opcode<037>, unsigned reg, unsigned addr) // ржа, ntr
+{
+    Aex      = ADDR(addr + core.M[reg]);
+    core.RAU = Aex & 077;
+}
 
-    case 034: // слпа, e+n
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add_exponent((Aex & 0177) - 64);
-        core.set_multiplicative();
-        break;
-
-    case 035: // вчпа, e-n
-        Aex = ADDR(addr + core.M[reg]);
-        arith_add_exponent(64 - (Aex & 0177));
-        core.set_multiplicative();
-        break;
-
-    case 036: { // сда, asn
-        int n;
-        Aex = ADDR(addr + core.M[reg]);
-        n   = (Aex & 0177) - 64;
-        arith_shift(n);
-        core.set_logical();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<040>, unsigned reg, unsigned addr) // уи, ati
+{
+    Aex               = ADDR(addr + core.M[reg]);
+    core.M[Aex & 017] = ADDR(core.ACC);
+    core.M[0]         = 0;
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<041>, unsigned reg, unsigned addr) // уим, sti
+{
+    unsigned rg, ad;
+
+    Aex = ADDR(addr + core.M[reg]);
+    rg  = Aex & 017;
+    ad  = ADDR(core.ACC);
+    if (rg != 017) {
+        core.M[017] = ADDR(core.M[017] - 1);
+        corr_stack  = 1;
     }
+    core.ACC   = machine.mem_load<TRACE>(rg != 017 ? core.M[017] : ad);
+    core.M[rg] = ad;
+    core.M[0]  = 0;
+    core.set_logical();
+}
 
-    case 037: // ржа, ntr
-        Aex      = ADDR(addr + core.M[reg]);
-        core.RAU = Aex & 077;
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<042>, unsigned reg, unsigned addr) // счи, ita
+{
+    Aex      = ADDR(addr + core.M[reg]);
+    core.ACC = ADDR(core.M[Aex & 017]);
+    core.set_logical();
+}
 
-    case 040: // уи, ati
-        Aex               = ADDR(addr + core.M[reg]);
-        core.M[Aex & 017] = ADDR(core.ACC);
-        core.M[0]         = 0;
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<043>, unsigned reg, unsigned addr) // счим, its
+{
+    machine.mem_store<TRACE>(core.M[017], core.ACC);
+    core.M[017] = ADDR(core.M[017] + 1);
+    execute<TRACE>(Opcode<042>(), reg, addr);
+}
 
-    case 041: { // уим, sti
-        unsigned rg, ad;
+template <bool TRACE>
+void Processor::execute(Opcode<044>, unsigned reg, unsigned addr) // уии, mtj
+{
+    Aex               = addr;
+    core.M[Aex & 017] = core.M[reg];
+    core.M[0]         = 0;
+}
 
-        Aex = ADDR(addr + core.M[reg]);
-        rg  = Aex & 017;
-        ad  = ADDR(core.ACC);
-        if (rg != 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        core.ACC   = machine.mem_load(rg != 017 ? core.M[017] : ad);
-        core.M[rg] = ad;
-        core.M[0]  = 0;
-        core.set_logical();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<045>, unsigned reg, unsigned addr) // сли, j+m
+{
+    Aex               = addr;
+    core.M[Aex & 017] = ADDR(core.M[Aex & 017] + core.M[reg]);
+    core.M[0]         = 0;
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<046>, unsigned, unsigned) // cоп, специальное обращение к памяти
+{
+    throw Exception("Illegal instruction 046 cоп");
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<047>, unsigned, unsigned) // э47, x47
+{
+    throw Exception("Illegal instruction 047");
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<0220>, unsigned reg, unsigned addr) // мода, utc
+{
+    Aex      = ADDR(addr + core.M[reg]);
+    next_mod = Aex;
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<0230>, unsigned reg, unsigned addr) // мод, wtc
+{
+    if (!addr && reg == 017) {
+        core.M[017] = ADDR(core.M[017] - 1);
+        corr_stack  = 1;
     }
+    Aex      = ADDR(addr + core.M[reg]);
+    next_mod = ADDR(machine.mem_load<TRACE>(Aex));
+}
 
-    case 042: // счи, ita
-load_modifier:
-        Aex      = ADDR(addr + core.M[reg]);
-        core.ACC = ADDR(core.M[Aex & 017]);
-        core.set_logical();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<0240>, unsigned reg, unsigned addr) // уиа, vtm
+{
+    Aex         = addr;
+    core.M[reg] = addr;
+    core.M[0]   = 0;
+}
 
-    case 043: // счим, its
-        machine.mem_store(core.M[017], core.ACC);
-        core.M[017] = ADDR(core.M[017] + 1);
-        goto load_modifier;
-
-    case 044: // уии, mtj
-        Aex               = addr;
-        core.M[Aex & 017] = core.M[reg];
-        core.M[0]         = 0;
-        break;
-
-    case 045: // сли, j+m
-        Aex               = addr;
-        core.M[Aex & 017] = ADDR(core.M[Aex & 017] + core.M[reg]);
-        core.M[0]         = 0;
-        break;
-
-    case 046: // cоп, специальное обращение к памяти
-        throw Exception("Illegal instruction 046 cоп");
-
-    case 047: // э47, x47
-        throw Exception("Illegal instruction 047");
-
-    case 050:
-    case 051:
-    case 052:
-    case 053:
-    case 054:
-    case 055:
-    case 056:
-    case 057:
-    case 060:
-    case 061:
-    case 062:
-    case 063:
-    case 064:
-    case 065:
-    case 066:
-    case 067:
-    case 070:
-    case 071:
-    case 072:
-    case 073:
-    case 074:
-    case 075:
-    case 076:
-    case 077:  // э50...э77
-    case 0200: // э20
-    case 0210: // э21
-        Aex        = ADDR(addr + core.M[reg]);
-        core.M[14] = Aex;
-        extracode(opcode);
-        core.set_logical();
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<0250>, unsigned reg, unsigned addr) // слиа, utm
+{
+    Aex         = ADDR(addr + core.M[reg]);
+    core.M[reg] = Aex;
+    core.M[0]   = 0;
+}
 
-    case 0220: // мода, utc
-        Aex      = ADDR(addr + core.M[reg]);
-        next_mod = Aex;
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<0260>, unsigned reg, unsigned addr) // по, uza
+{
+    Aex      = ADDR(addr + core.M[reg]);
+    core.RMR = core.ACC;
+    if (core.is_additive()) {
+        if (core.ACC & BIT41)
+            return;
+    } else if (core.is_multiplicative()) {
+        if (!(core.ACC & BIT48))
+            return;
+    } else if (core.is_logical()) {
+        if (core.ACC)
+            return;
+    } else
+        return;
+    core.PC               = Aex;
+    core.right_instr_flag = false;
+}
 
-    case 0230: // мод, wtc
-        if (!addr && reg == 017) {
-            core.M[017] = ADDR(core.M[017] - 1);
-            corr_stack  = 1;
-        }
-        Aex      = ADDR(addr + core.M[reg]);
-        next_mod = ADDR(machine.mem_load(Aex));
-        break;
-
-    case 0240: // уиа, vtm
-        Aex         = addr;
-        core.M[reg] = addr;
-        core.M[0]   = 0;
-        break;
-
-    case 0250: // слиа, utm
-        Aex         = ADDR(addr + core.M[reg]);
-        core.M[reg] = Aex;
-        core.M[0]   = 0;
-        break;
-
-    case 0260: // по, uza
-        Aex      = ADDR(addr + core.M[reg]);
-        core.RMR = core.ACC;
-        if (core.is_additive()) {
-            if (core.ACC & BIT41)
-                break;
-        } else if (core.is_multiplicative()) {
-            if (!(core.ACC & BIT48))
-                break;
-        } else if (core.is_logical()) {
-            if (core.ACC)
-                break;
-        } else
-            break;
-        core.PC               = Aex;
-        core.right_instr_flag = false;
-        break;
-
-    case 0270: // пе, u1a
-        Aex      = ADDR(addr + core.M[reg]);
-        core.RMR = core.ACC;
-        if (core.is_additive()) {
-            if (!(core.ACC & BIT41))
-                break;
-        } else if (core.is_multiplicative()) {
-            if (core.ACC & BIT48)
-                break;
-        } else if (core.is_logical()) {
-            if (!core.ACC)
-                break;
-        } else {
-            // fall thru, i.e. branch
-        }
-        core.PC               = Aex;
-        core.right_instr_flag = false;
-        break;
+template <bool TRACE>
+void Processor::execute(Opcode<0270>, unsigned reg, unsigned addr) // пе, u1a
+{
+    Aex      = ADDR(addr + core.M[reg]);
+    core.RMR = core.ACC;
+    if (core.is_additive()) {
+        if (!(core.ACC & BIT41))
+            return;
+    } else if (core.is_multiplicative()) {
+        if (core.ACC & BIT48)
+            return;
+    } else if (core.is_logical()) {
+        if (!core.ACC)
+            return;
+    } else {
+        // fall thru, i.e. branch
+    }
+    core.PC               = Aex;
+    core.right_instr_flag = false;
+}
 
-    case 0300: // пб, uj
-        Aex                   = ADDR(addr + core.M[reg]);
-        core.PC               = Aex;
+template <bool TRACE>
+void Processor::execute(Opcode<0300>, unsigned reg, unsigned addr) // пб, uj
+{
+    Aex                   = ADDR(addr + core.M[reg]);
+    core.PC               = Aex;
+    core.right_instr_flag = false;
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<0310>, unsigned reg, unsigned addr) // пв, vjm
+{
+    // Return address: PC has been already advanced past this instruction.
+    unsigned nextpc = core.right_instr_flag ? ADDR(core.PC + 1) : ADDR(core.PC);
+
+    Aex                   = addr;
+    core.M[reg]           = nextpc;
+    core.M[0]             = 0;
+    core.PC               = addr;
+    core.right_instr_flag = false;
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<0320>, unsigned, unsigned) // выпр, iret
+{
+    throw Exception("Illegal instruction 32 выпр/iret");
+}
+
+template <bool TRACE>
+void Processor::execute(Opcode<0340>, unsigned reg, unsigned addr) // пио, vzm
+{
+    Aex = addr;
+    if (!core.M[reg]) {
+        core.PC               = addr;
         core.right_instr_flag = false;
-        break;
+    }
+}
 
-    case 0310: // пв, vjm
-        Aex                   = addr;
-        core.M[reg]           = nextpc;
-        core.M[0]             = 0;
+template <bool TRACE>
+void Processor::execute(Opcode<0350>, unsigned reg, unsigned addr) // пино, v1m
+{
+    Aex = addr;
+    if (core.M[reg]) {
         core.PC               = addr;
         core.right_instr_flag = false;
-        break;
+    }
+}
 
-    case 0320: // выпр, iret
-        throw Exception("Illegal instruction 32 выпр/iret");
+template <bool TRACE>
+void Processor::execute(Opcode<0360>, unsigned reg, unsigned addr) // э36, *36
+{
+    // Как ПИО, но с выталкиванием БРЗ.
+    execute<TRACE>(Opcode<0340>(), reg, addr);
+}
 
-    case 0330: // стоп, stop
-        // We are done.
-        return true;
+template <bool TRACE>
+void Processor::execute(Opcode<0370>, unsigned reg, unsigned addr) // цикл, vlm
+{
+    Aex = addr;
+    if (!core.M[reg])
+        return;
+    core.M[reg]           = ADDR(core.M[reg] + 1);
+    core.PC               = addr;
+    core.right_instr_flag = false;
+}
+
+//
+// Table of handlers, indexed by opcode.
+//
+template <std::size_t... OPCODE>
+const Processor::Handler *Processor::handler_table(std::index_sequence<OPCODE...>)
+{
+    static const Handler table[] = { &Processor::handler<OPCODE>... };
+    return table;
+}
 
-    case 0340: // пио, vzm
-branch_zero:
-        Aex = addr;
-        if (!core.M[reg]) {
-            core.PC               = addr;
-            core.right_instr_flag = false;
+//
+// Forget decoded instructions at the given address range.
+// Called when memory contents is changed.
+// Superblocks over this range are flushed before next use.
+//
+void Processor::invalidate(unsigned addr, unsigned nwords)
+{
+    for (; nwords > 0; nwords--, addr++) {
+        decoded[addr * 2].handler     = nullptr;
+        decoded[addr * 2 + 1].handler = nullptr;
+        if (block_words[addr]) {
+            dirty_pages |= 1u << (addr / PAGE_NWORDS);
         }
-        break;
+    }
+}
+
+//
+// Fetch instruction word at the given address, and decode both halves.
+// The right instruction is usually executed right after the left one,
+// so one fetch serves them both.
+//
+void Processor::decode(unsigned addr)
+{
+    Word word = machine.mem_fetch(addr);
+
+    decode_half(decoded[addr * 2], (unsigned)(word >> 24)); // left instruction
+    decode_half(decoded[addr * 2 + 1], (unsigned)word);     // right instruction
+}
+
+//
+// Decode one instruction.
+//
+void Processor::decode_half(Instruction &ins, unsigned rk)
+{
+    rk &= BITS(24);
+
+    ins.RK  = rk;
+    ins.reg = rk >> 20;
+    if (rk & ONEBIT(20)) {
+        ins.addr   = rk & BITS(15);
+        ins.opcode = (rk >> 12) & 0370;
+    } else {
+        ins.addr = rk & BITS(12);
+        if (rk & ONEBIT(19))
+            ins.addr |= 070000;
+        ins.opcode = (rk >> 12) & 077;
+    }
 
-    case 0350: // пино, v1m
-        Aex = addr;
-        if (core.M[reg]) {
-            core.PC               = addr;
-            core.right_instr_flag = false;
+    // Choose specialized handler of memory-reference instruction.
+    // When the address is modified by utc/wtc, the generic one is used instead.
+    // Prefix utc/wtc is executed in pair with the next instruction.
+    ins.entry = ins.opcode;
+    if (ins.opcode >= MEMORY_FIRST && ins.opcode < MEMORY_FIRST + MEMORY_NCODES) {
+        if (ins.addr == 0 && ins.reg == 017) {
+            ins.entry = entry_of(ins.opcode, AddrMode::STACK);
+        } else if (ins.reg == 0) {
+            ins.entry = entry_of(ins.opcode, AddrMode::DIRECT);
+        } else {
+            ins.entry = entry_of(ins.opcode, AddrMode::INDEX);
         }
-        break;
+    } else if (ins.opcode == 0220) {
+        ins.entry = ENTRY_PAIR_UTC;
+    } else if (ins.opcode == 0230) {
+        ins.entry = ENTRY_PAIR_WTC;
+    }
 
-    case 0360: // э36, *36
-        // Как ПИО, но с выталкиванием БРЗ.
-        goto branch_zero;
+    static const Handler *const handlers = handler_table(std::make_index_sequence<0400>());
+    ins.handler = handlers[ins.opcode];
+}
 
-    case 0370: // цикл, vlm
-        Aex = addr;
-        if (!core.M[reg])
-            break;
-        core.M[reg]           = ADDR(core.M[reg] + 1);
-        core.PC               = addr;
+//
+// Get decoded instruction at PC+right_instr_flag.
+// Fetch and decode it on first use.
+//
+template <bool TRACE>
+ALWAYS_INLINE const Instruction &Processor::fetch_decoded()
+{
+    Instruction &ins = decoded[core.PC * 2 + core.right_instr_flag];
+
+    if (!ins.handler) {
+        decode(core.PC);
+    } else if (TRACE && !core.right_instr_flag) {
+        // Fetch trace is emitted for left instructions only.
+        machine.trace_fetch(core.PC);
+    }
+    return ins;
+}
+
+//
+// Fetch and decode instruction at PC+right_instr_flag, and advance PC.
+// Compute address of the instruction, modified by previous utc/wtc.
+//
+template <bool TRACE>
+ALWAYS_INLINE const Instruction &Processor::begin_instruction(unsigned &addr)
+{
+    corr_stack = 0;
+    core.PC &= BITS(15);
+
+    const Instruction &ins = fetch_decoded<TRACE>();
+    addr                   = ins.addr;
+
+    if (TRACE) {
+        // Show instruction: address, opcode and mnemonics.
+        RK = ins.RK;
+        machine.trace_instruction(ins.opcode);
+    }
+
+    advance_pc(addr);
+    return ins;
+}
+
+//
+// Advance PC past current instruction.
+// Modify the address by previous utc/wtc.
+//
+ALWAYS_INLINE void Processor::advance_pc(unsigned &addr)
+{
+    if (core.right_instr_flag) {
+        core.PC += 1; // increment PC
         core.right_instr_flag = false;
-        break;
+    } else {
+        core.right_instr_flag = true;
+    }
 
-    default:
-        // Unknown instruction - cannot happen.
-        throw Exception("Unknown instruction");
+    if (core.apply_mod_reg) {
+        addr = ADDR(addr + core.MOD);
     }
+    next_mod = 0;
+}
 
+//
+// Set address modifier for the next instruction.
+//
+ALWAYS_INLINE void Processor::update_mod()
+{
     if (next_mod != 0) {
         // Модификация адреса следующей команды.
         core.MOD           = next_mod;
@@ -626,8 +784,812 @@ branch_zero:
     } else {
         core.apply_mod_reg = false;
     }
+}
+
+//
+// Complete execution of instruction.
+//
+template <bool TRACE>
+ALWAYS_INLINE void Processor::end_instruction()
+{
+    update_mod();
+
+    if (TRACE) {
+        // Show changed registers.
+        machine.trace_registers();
+    }
+}
 
-    // Show changed registers.
-    machine.trace_registers();
+//
+// Execute one instruction, placed at address PC+right_instr_flag.
+// Return false to continue the program.
+// Return true when the program is done and the processor is stopped.
+// Emit exception in case of failure.
+//
+bool Processor::step()
+{
+    unsigned addr;
+    const Instruction &ins = begin_instruction<true>(addr);
+
+    if (ins.opcode == 0330) {
+        // стоп, stop: we are done.
+        return true;
+    }
+    ins.handler(*this, ins.reg, addr);
+    end_instruction<true>();
     return false;
 }
+
+//
+// Threaded engine: execute up to the given number of instructions in one call.
+// Every opcode has its own copy of dispatch code, so the host branch predictor
+// can learn which opcode usually follows which.
+// With SUPERBLOCKS, instructions are executed by whole superblocks
+// without fetch from memory, and counted once per block.
+// Return true when the processor is stopped.
+// Return false when the budget is used up, or after an extracode.
+// Emit exception in case of failure.
+// Count instructions in machine.simulated_instructions.
+//
+template <bool SUPERBLOCKS, bool TRACE>
+bool Processor::dispatch(uint64_t budget)
+{
+#if defined(__GNUC__)
+    // Labels of opcode handlers, indexed by dispatch entry.
+    // Entries 0100-0173 are memory-reference opcodes, specialized by addressing mode.
+    // Entries 0174-0175 are utc/wtc prefixes, fused with the next instruction.
+    static void *const labels[0400] = {
+        &&op_000, &&op_001, &&op_002, &&op_003, &&op_004, &&op_005, &&op_006, &&op_007,
+        &&op_010, &&op_011, &&op_012, &&op_013, &&op_014, &&op_015, &&op_016, &&op_017,
+        &&op_020, &&op_021, &&op_022, &&op_023, &&op_024, &&op_025, &&op_026, &&op_027,
+        &&op_030, &&op_031, &&op_032, &&op_033, &&op_034, &&op_035, &&op_036, &&op_037,
+        &&op_040, &&op_041, &&op_042, &&op_043, &&op_044, &&op_045, &&op_046, &&op_047,
+        &&op_050, &&op_051, &&op_052, &&op_053, &&op_054, &&op_055, &&op_056, &&op_057,
+        &&op_060, &&op_061, &&op_062, &&op_063, &&op_064, &&op_065, &&op_066, &&op_067,
+        &&op_070, &&op_071, &&op_072, &&op_073, &&op_074, &&op_075, &&op_076, &&op_077,
+        &&op_100, &&op_101, &&op_102, &&op_103, &&op_104, &&op_105, &&op_106, &&op_107,
+        &&op_110, &&op_111, &&op_112, &&op_113, &&op_114, &&op_115, &&op_116, &&op_117,
+        &&op_120, &&op_121, &&op_122, &&op_123, &&op_124, &&op_125, &&op_126, &&op_127,
+        &&op_130, &&op_131, &&op_132, &&op_133, &&op_134, &&op_135, &&op_136, &&op_137,
+        &&op_140, &&op_141, &&op_142, &&op_143, &&op_144, &&op_145, &&op_146, &&op_147,
+        &&op_150, &&op_151, &&op_152, &&op_153, &&op_154, &&op_155, &&op_156, &&op_157,
+        &&op_160, &&op_161, &&op_162, &&op_163, &&op_164, &&op_165, &&op_166, &&op_167,
+        &&op_170, &&op_171, &&op_172, &&op_173, &&op_pair_utc, &&op_pair_wtc, &&op_unknown, &&op_unknown,
+        &&op_200, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_210, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_220, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_230, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_240, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_250, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_260, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_270, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_300, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_310, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_320, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_330, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_340, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_350, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_360, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+        &&op_370, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown,
+    };
+    const Instruction *ins = nullptr;
+    unsigned addr;
+
+    // Current superblock: instructions from start to end, op is the next one.
+    Block *block             = nullptr;
+    const Instruction *start = nullptr;
+    const Instruction *op    = nullptr;
+    const Instruction *end   = nullptr;
+
+    // Without superblocks, instructions are counted once on exit:
+    // the count is budget0 - budget.
+    const uint64_t budget0 = budget;
+
+// Fetch next instruction and jump to the handler.
+// Address modified by utc/wtc needs the generic handler.
+#define DISPATCH()                                                \
+    if (SUPERBLOCKS) {                                            \
+        if (op == end || dirty_pages)                             \
+            goto block_end;                                       \
+        ins = op++;                                               \
+        corr_stack = 0;                                           \
+        addr       = ins->addr;                                   \
+        advance_pc(addr);                                         \
+    } else {                                                      \
+        if (budget == 0) {                                        \
+            machine.add_simulated_instructions(budget0);         \
+            return false;                                         \
+        }                                                         \
+        budget--;                                                 \
+        ins = &begin_instruction<TRACE>(addr);                    \
+    }                                                             \
+    goto *labels[core.apply_mod_reg ? ins->opcode : ins->entry]
+
+// Complete the instruction and proceed to the next one.
+#define END_INSTRUCTION()                                         \
+    if (SUPERBLOCKS) {                                            \
+        update_mod();                                             \
+    } else {                                                      \
+        end_instruction<TRACE>();                                 \
+    }                                                             \
+    DISPATCH()
+
+// Complete the extracode and return to the machine.
+#define END_EXTRACODE()                                           \
+    if (SUPERBLOCKS) {                                            \
+        update_mod();                                             \
+        machine.add_simulated_instructions(op - start);          \
+    } else {                                                      \
+        end_instruction<TRACE>();                                 \
+        machine.add_simulated_instructions(budget0 - budget);    \
+    }                                                             \
+    return false
+
+// Complete the utc/wtc prefix, decoded as a pair with the next instruction,
+// and proceed to the target with no dispatch check of its own: the prefix
+// cannot overwrite memory, so superblocks stay valid. The modified address
+// goes to the specialized handler of the target, except with register M[017],
+// when the modified address may select the stack form. Both are counted.
+// When tracing, or at the end of block or budget, finish as usual.
+#define END_PAIR(prefix)                                          \
+    if (TRACE || (SUPERBLOCKS ? op == end : budget == 0)) {       \
+        END_INSTRUCTION();                                        \
+    }                                                             \
+    update_mod();                                                 \
+    if (SUPERBLOCKS) {                                            \
+        ins        = op++;                                        \
+        corr_stack = 0;                                           \
+        addr       = ins->addr;                                   \
+        advance_pc(addr);                                         \
+    } else {                                                      \
+        budget--;                                                 \
+        ins = &begin_instruction<false>(addr);                    \
+    }                                                             \
+    if (fused_count_enabled) {                                    \
+        fused_count[prefix][ins->opcode]++;                       \
+    }                                                             \
+    goto *labels[ins->reg == 017 ? ins->opcode : ins->entry]
+
+    try {
+        DISPATCH();
+
+    block_end:
+        // End of superblock: count instructions and proceed to the next block.
+        machine.add_simulated_instructions(op - start);
+        budget -= op - start;
+        if (block && block->loop_reg) {
+            budget -= skip_loop(block, budget);
+        }
+        ins = start = op;
+        block       = next_block(block);
+        if (block->length > budget) {
+            // Not enough budget for whole block: finish by single instructions.
+            return dispatch<false, false>(budget);
+        }
+        ins = start = op = &decoded[block->start];
+        end              = start + block->length;
+        if (block->native && !core.apply_mod_reg) {
+            // Code translated ahead of time, see aot.h.
+            op = start + block->native(*this, core);
+            if (jit_exception) {
+                // Instruction which has raised exception is not counted.
+                ins = op - 1;
+                std::rethrow_exception(std::exchange(jit_exception, nullptr));
+            }
+            if (op == end) {
+                if (end[-1].opcode == 0330) {
+                    // стоп, stop: we are done.
+                    machine.add_simulated_instructions(op - start);
+                    return true;
+                }
+                if (is_extracode(end[-1].opcode)) {
+                    machine.add_simulated_instructions(op - start);
+                    return false;
+                }
+            } else {
+                // Left the block early: some superblock was overwritten.
+                block = nullptr;
+            }
+            goto block_end;
+        }
+        DISPATCH();
+
+    op_000:
+        execute<TRACE>(Opcode<00>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_001:
+        execute<TRACE>(Opcode<01>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_002:
+        execute<TRACE>(Opcode<02>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_003:
+        execute<TRACE>(Opcode<03>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_004:
+        execute<TRACE>(Opcode<04>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_005:
+        execute<TRACE>(Opcode<05>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_006:
+        execute<TRACE>(Opcode<06>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_007:
+        execute<TRACE>(Opcode<07>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_010:
+        execute<TRACE>(Opcode<010>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_011:
+        execute<TRACE>(Opcode<011>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_012:
+        execute<TRACE>(Opcode<012>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_013:
+        execute<TRACE>(Opcode<013>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_014:
+        execute<TRACE>(Opcode<014>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_015:
+        execute<TRACE>(Opcode<015>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_016:
+        execute<TRACE>(Opcode<016>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_017:
+        execute<TRACE>(Opcode<017>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_020:
+        execute<TRACE>(Opcode<020>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_021:
+        execute<TRACE>(Opcode<021>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_022:
+        execute<TRACE>(Opcode<022>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_023:
+        execute<TRACE>(Opcode<023>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_024:
+        execute<TRACE>(Opcode<024>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_025:
+        execute<TRACE>(Opcode<025>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_026:
+        execute<TRACE>(Opcode<026>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_027:
+        execute<TRACE>(Opcode<027>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_030:
+        execute<TRACE>(Opcode<030>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_031:
+        execute<TRACE>(Opcode<031>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_032:
+        execute<TRACE>(Opcode<032>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_033:
+        execute<TRACE>(Opcode<033>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_034:
+        execute<TRACE>(Opcode<034>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_035:
+        execute<TRACE>(Opcode<035>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_036:
+        execute<TRACE>(Opcode<036>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_037:
+        execute<TRACE>(Opcode<037>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_040:
+        execute<TRACE>(Opcode<040>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_041:
+        execute<TRACE>(Opcode<041>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_042:
+        execute<TRACE>(Opcode<042>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_043:
+        execute<TRACE>(Opcode<043>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_044:
+        execute<TRACE>(Opcode<044>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_045:
+        execute<TRACE>(Opcode<045>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_046:
+        execute<TRACE>(Opcode<046>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_047:
+        execute<TRACE>(Opcode<047>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_050:
+        execute<TRACE>(Opcode<050>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_051:
+        execute<TRACE>(Opcode<051>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_052:
+        execute<TRACE>(Opcode<052>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_053:
+        execute<TRACE>(Opcode<053>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_054:
+        execute<TRACE>(Opcode<054>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_055:
+        execute<TRACE>(Opcode<055>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_056:
+        execute<TRACE>(Opcode<056>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_057:
+        execute<TRACE>(Opcode<057>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_060:
+        execute<TRACE>(Opcode<060>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_061:
+        execute<TRACE>(Opcode<061>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_062:
+        execute<TRACE>(Opcode<062>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_063:
+        execute<TRACE>(Opcode<063>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_064:
+        execute<TRACE>(Opcode<064>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_065:
+        execute<TRACE>(Opcode<065>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_066:
+        execute<TRACE>(Opcode<066>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_067:
+        execute<TRACE>(Opcode<067>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_070:
+        execute<TRACE>(Opcode<070>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_071:
+        execute<TRACE>(Opcode<071>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_072:
+        execute<TRACE>(Opcode<072>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_073:
+        execute<TRACE>(Opcode<073>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_074:
+        execute<TRACE>(Opcode<074>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_075:
+        execute<TRACE>(Opcode<075>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_076:
+        execute<TRACE>(Opcode<076>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_077:
+        execute<TRACE>(Opcode<077>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_100:
+        execute_entry<TRACE, 0100>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_101:
+        execute_entry<TRACE, 0101>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_102:
+        execute_entry<TRACE, 0102>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_103:
+        execute_entry<TRACE, 0103>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_104:
+        execute_entry<TRACE, 0104>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_105:
+        execute_entry<TRACE, 0105>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_106:
+        execute_entry<TRACE, 0106>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_107:
+        execute_entry<TRACE, 0107>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_110:
+        execute_entry<TRACE, 0110>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_111:
+        execute_entry<TRACE, 0111>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_112:
+        execute_entry<TRACE, 0112>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_113:
+        execute_entry<TRACE, 0113>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_114:
+        execute_entry<TRACE, 0114>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_115:
+        execute_entry<TRACE, 0115>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_116:
+        execute_entry<TRACE, 0116>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_117:
+        execute_entry<TRACE, 0117>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_120:
+        execute_entry<TRACE, 0120>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_121:
+        execute_entry<TRACE, 0121>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_122:
+        execute_entry<TRACE, 0122>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_123:
+        execute_entry<TRACE, 0123>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_124:
+        execute_entry<TRACE, 0124>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_125:
+        execute_entry<TRACE, 0125>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_126:
+        execute_entry<TRACE, 0126>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_127:
+        execute_entry<TRACE, 0127>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_130:
+        execute_entry<TRACE, 0130>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_131:
+        execute_entry<TRACE, 0131>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_132:
+        execute_entry<TRACE, 0132>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_133:
+        execute_entry<TRACE, 0133>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_134:
+        execute_entry<TRACE, 0134>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_135:
+        execute_entry<TRACE, 0135>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_136:
+        execute_entry<TRACE, 0136>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_137:
+        execute_entry<TRACE, 0137>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_140:
+        execute_entry<TRACE, 0140>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_141:
+        execute_entry<TRACE, 0141>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_142:
+        execute_entry<TRACE, 0142>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_143:
+        execute_entry<TRACE, 0143>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_144:
+        execute_entry<TRACE, 0144>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_145:
+        execute_entry<TRACE, 0145>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_146:
+        execute_entry<TRACE, 0146>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_147:
+        execute_entry<TRACE, 0147>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_150:
+        execute_entry<TRACE, 0150>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_151:
+        execute_entry<TRACE, 0151>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_152:
+        execute_entry<TRACE, 0152>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_153:
+        execute_entry<TRACE, 0153>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_154:
+        execute_entry<TRACE, 0154>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_155:
+        execute_entry<TRACE, 0155>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_156:
+        execute_entry<TRACE, 0156>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_157:
+        execute_entry<TRACE, 0157>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_160:
+        execute_entry<TRACE, 0160>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_161:
+        execute_entry<TRACE, 0161>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_162:
+        execute_entry<TRACE, 0162>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_163:
+        execute_entry<TRACE, 0163>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_164:
+        execute_entry<TRACE, 0164>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_165:
+        execute_entry<TRACE, 0165>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_166:
+        execute_entry<TRACE, 0166>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_167:
+        execute_entry<TRACE, 0167>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_170:
+        execute_entry<TRACE, 0170>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_171:
+        execute_entry<TRACE, 0171>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_172:
+        execute_entry<TRACE, 0172>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_173:
+        execute_entry<TRACE, 0173>(ins->reg, addr);
+        END_INSTRUCTION();
+    op_pair_utc:
+        execute<TRACE>(Opcode<0220>(), ins->reg, addr);
+        END_PAIR(0);
+    op_pair_wtc:
+        execute<TRACE>(Opcode<0230>(), ins->reg, addr);
+        END_PAIR(1);
+    op_200:
+        execute<TRACE>(Opcode<0200>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_210:
+        execute<TRACE>(Opcode<0210>(), ins->reg, addr);
+        END_EXTRACODE();
+    op_220:
+        execute<TRACE>(Opcode<0220>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_230:
+        execute<TRACE>(Opcode<0230>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_240:
+        execute<TRACE>(Opcode<0240>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_250:
+        execute<TRACE>(Opcode<0250>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_260:
+        execute<TRACE>(Opcode<0260>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_270:
+        execute<TRACE>(Opcode<0270>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_300:
+        execute<TRACE>(Opcode<0300>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_310:
+        execute<TRACE>(Opcode<0310>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_320:
+        execute<TRACE>(Opcode<0320>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_330:
+        // стоп, stop: we are done.
+        if (SUPERBLOCKS) {
+            machine.add_simulated_instructions(op - start);
+        } else {
+            machine.add_simulated_instructions(budget0 - budget);
+        }
+        return true;
+    op_340:
+        execute<TRACE>(Opcode<0340>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_350:
+        execute<TRACE>(Opcode<0350>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_360:
+        execute<TRACE>(Opcode<0360>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_370:
+        execute<TRACE>(Opcode<0370>(), ins->reg, addr);
+        END_INSTRUCTION();
+    op_unknown:
+        // Unknown instruction - cannot happen.
+        throw Exception("Unknown instruction");
+
+    } catch (...) {
+        // Count completed instructions: the one which has failed is not counted.
+        if (SUPERBLOCKS) {
+            machine.add_simulated_instructions(ins - start);
+        } else {
+            machine.add_simulated_instructions(budget0 - budget - 1);
+        }
+        throw;
+    }
+
+#undef DISPATCH
+#undef END_INSTRUCTION
+#undef END_EXTRACODE
+#undef END_PAIR
+#else
+    // No computed goto: call handlers one by one.
+    while (budget-- > 0) {
+        unsigned addr;
+        const Instruction &ins = begin_instruction<TRACE>(addr);
+
+        if (ins.opcode == 0330) {
+            // стоп, stop: we are done.
+            machine.incr_simulated_instructions();
+            return true;
+        }
+        ins.handler(*this, ins.reg, addr);
+        end_instruction<TRACE>();
+        machine.incr_simulated_instructions();
+
+        if (is_extracode(ins.opcode)) {
+            return false;
+        }
+    }
+    return false;
+#endif
+}
+
+//
+// Simulate up to the given number of instructions, using the given engine.
+// Engines return after every extracode, to check for e74.
+// Return the reason of stop.
+//
+StopReason Processor::run(Runner engine, uint64_t budget)
+{
+    job_done = false;
+    pause    = false;
+    try {
+        while (budget > 0) {
+            uint64_t count0 = machine.get_instr_count();
+            if ((this->*engine)(budget)) {
+                return StopReason::HALT;
+            }
+            if (job_done) {
+                return StopReason::FINISH;
+            }
+            if (pause) {
+                return StopReason::PAUSE;
+            }
+            budget -= machine.get_instr_count() - count0;
+        }
+    } catch (const Exception &ex) {
+        // Unexpected situation in the machine.
+        stack_correction();
+        fault = ex.what();
+        return StopReason::FAULT;
+    }
+    return StopReason::LIMIT;
+}
+
+//
+// Reference engine: one instruction at a time.
+//
+bool Processor::run_step(uint64_t budget)
+{
+    for (; budget > 0; budget--) {
+        bool done = step();
+        machine.incr_simulated_instructions();
+        if (done || job_done || pause) {
+            return done;
+        }
+    }
+    return false;
+}
+
+//
+// Threaded engine over instructions in memory.
+//
+bool Processor::run_threaded(uint64_t budget)
+{
+    return dispatch<false, false>(budget);
+}
+
+//
+// Threaded engine with trace.
+//
+bool Processor::run_traced(uint64_t budget)
+{
+    return dispatch<false, true>(budget);
+}
+
+//
+// Threaded engine over superblocks.
+//
+bool Processor::run_blocks(uint64_t budget)
+{
+    return dispatch<true, false>(budget);
+}
+
+//
+// Execute one instruction from translated code, see jit.cpp.
+// PC is already advanced by translated code.
+// Return non-zero to leave the block: on stop, on exception,
+// or when some superblock was overwritten.
+//
+template <unsigned OPCODE, bool MOD>
+unsigned Processor::jit_step(Processor &cpu, unsigned reg, unsigned addr)
+{
+    try {
+        cpu.corr_stack = 0;
+        if (MOD && cpu.core.apply_mod_reg) {
+            addr = ADDR(addr + cpu.core.MOD);
+        }
+        if constexpr (OPCODE == 0330) {
+            // стоп, stop: leave the block.
+            return 1;
+        } else {
+            if (MOD) {
+                // Otherwise next_mod is used only after utc/wtc, which set it.
+                cpu.next_mod = 0;
+            }
+            if (MOD) {
+                cpu.execute<false>(Opcode<OPCODE>(), reg, addr);
+            } else {
+                cpu.execute_entry<false, OPCODE>(reg, addr);
+            }
+            if (MOD || OPCODE == 0220 || OPCODE == 0230 || OPCODE == ENTRY_PAIR_UTC ||
+                OPCODE == ENTRY_PAIR_WTC) {
+                cpu.update_mod();
+            }
+        }
+    } catch (...) {
+        // Exceptions cannot pass through translated code.
+        cpu.jit_exception = std::current_exception();
+        return 1;
+    }
+    return cpu.dirty_pages != 0;
+}
+
+//
+// Tables of helpers for translated code, indexed by dispatch entry.
+//
+template <bool MOD, std::size_t... OPCODE>
+const Processor::JitHelper *Processor::jit_table(std::index_sequence<OPCODE...>)
+{
+    static const JitHelper table[] = { &Processor::jit_step<OPCODE, MOD>... };
+    return table;
+}
+
+const Processor::JitHelper *Processor::jit_helpers(bool mod)
+{
+    static const JitHelper *const helpers     = jit_table<false>(std::make_index_sequence<0400>());
+    static const JitHelper *const mod_helpers = jit_table<true>(std::make_index_sequence<0400>());
+    return mod ? mod_helpers : helpers;
+}
@@ -25,7 +25,13 @@
 #define DUBNA_PROCESSOR_H
 
 #include <cstdint>
+#include <exception>
+#include <iosfwd>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "besm6_arch.h"
 #include "extracode.h"
@@ -33,6 +39,8 @@
 class Machine;
 class Memory;
 class MantissaExponent;
+class Processor;
+class Jit;
 
 //
 // Internal state of the processor.
@@ -71,6 +79,51 @@ struct CoreState {
     }
 };
 
+//
+// Why the simulation has stopped, see Processor::run().
+//
+enum class StopReason {
+    HALT,     // stopped by 'стоп' instruction
+    FINISH,   // job finished by extracode e74
+    LIMIT,    // budget of instructions is used up
+    FAULT,    // exception in the processor, see Processor::get_fault()
+    PROGRESS, // time to show progress, see Machine::run()
+    PAUSE,    // paused at request of the machine, see Processor::request_pause()
+};
+
+//
+// Addressing modes of memory-reference instructions (opcodes 004-027).
+// Handlers are specialized for every mode, which is chosen at decode time.
+//
+enum class AddrMode {
+    GENERIC, // address modified by utc/wtc: check the stack form at run time
+    STACK,   // addr=0, reg=017: pop the operand from stack
+    DIRECT,  // reg=0: no index register
+    INDEX,   // address indexed by register
+};
+
+//
+// Decoded instruction, cached for every half-word of memory.
+// Empty handler means the entry must be decoded again.
+//
+struct Instruction {
+    void (*handler)(Processor &cpu, unsigned reg, unsigned addr); // execute the opcode
+    unsigned RK : 24;                                              // instruction code, for trace
+    unsigned entry : 8;                                            // dispatch entry, see decode()
+    uint16_t addr;                                                 // address, before modification
+    uint8_t opcode;                                                // operation code
+    uint8_t reg;                                                   // index register
+};
+
+//
+// Superblock, recorded for translation ahead of time, see aotgen.cpp.
+//
+struct BlockImage {
+    unsigned start;                // PC*2 + right_instr_flag
+    std::vector<Instruction> code; // decoded instructions
+    uint64_t hash;                 // hash of memory words, see Processor::block_hash()
+};
+
 //
 // BESM-6 processor.
 //
@@ -88,9 +141,244 @@ private:
     // Previous state, for tracing.
     struct CoreState prev {};
 
-    unsigned RK{};    // регистр команд
-    unsigned Aex{};   // executive address
-    int corr_stack{}; // stack correction on exception
+    unsigned RK{};       // регистр команд
+    unsigned Aex{};      // executive address
+    int corr_stack{};    // stack correction on exception
+    unsigned next_mod{}; // address modifier for the next instruction
+    bool job_done{};     // job finished by extracode e74
+    bool pause{};        // stop after this instruction, see request_pause()
+    std::string fault;   // message of the last exception
+
+    // Decoded instructions, two per memory word.
+    std::vector<Instruction> decoded;
+
+    // Get decoded instruction at PC, fetch and decode on first use.
+    template <bool TRACE>
+    const Instruction &fetch_decoded();
+    void decode(unsigned addr);
+    static void decode_half(Instruction &ins, unsigned rk);
+
+    // Common parts of instruction execution.
+    // Without TRACE, no trace checks are compiled in.
+    template <bool TRACE>
+    const Instruction &begin_instruction(unsigned &addr);
+    template <bool TRACE>
+    void end_instruction();
+    void advance_pc(unsigned &addr);
+    void update_mod();
+
+    // Superblock translated into host code: return number of instructions
+    // executed, including the one which has left the block.
+    using Native = unsigned (*)(Processor &cpu, CoreState &core);
+
+    //
+    // Superblock: straight-line code from a jump target up to the next
+    // jump, stop or extracode. Instructions are taken from the decoded[] array.
+    //
+    struct Block {
+        unsigned start;  // index of first instruction in decoded[]
+        unsigned length; // number of instructions, zero when not translated
+        Block *chain[2]; // successors, seen recently
+
+        // Translated code, see jit.cpp and aot.h.
+        Native native;
+        unsigned hits; // executions before translation
+
+        // Counting loop: register of vlm which jumps back to the start, or 0.
+        unsigned loop_reg;
+    };
+    std::vector<Block> block_map;                                   // superblocks by start
+    std::vector<unsigned> page_blocks[MEMORY_NWORDS / PAGE_NWORDS]; // starts of blocks by page
+    std::vector<uint8_t> block_words;                               // words covered by blocks
+    uint32_t dirty_pages{};                                         // pages with overwritten blocks
+
+    // Get superblock at PC, via chain of the previous block when possible.
+    Block *next_block(Block *from);
+    Block *find_block(Block *from);
+    Block *translate_block(unsigned start);
+    void flush_blocks(uint32_t page_mask);
+
+    // Counting loops of vlm, skipped in closed form.
+    unsigned loop_register(unsigned start, unsigned length) const;
+    uint64_t skip_loop(const Block *block, uint64_t budget);
+    uint64_t loop_hits{};    // loops skipped
+    uint64_t loop_skipped{}; // instructions skipped
+
+    // Threaded engine, over decoded instructions or over superblocks.
+    // Superblocks are never traced.
+    template <bool SUPERBLOCKS, bool TRACE>
+    bool dispatch(uint64_t budget);
+
+    // Counters of utc/wtc prefixes, fused with the next instruction by dispatch().
+    // Indexed by prefix (0 - utc, 1 - wtc) and by opcode of the next instruction.
+    // Counted only when enabled.
+    bool fused_count_enabled{};
+    uint64_t fused_count[2][0400]{};
+
+    // Translation of superblocks into host code.
+    std::unique_ptr<Jit> jit;
+    std::exception_ptr jit_exception; // raised by translated code
+
+    // Helpers for translated code: execute one instruction, return non-zero to leave the block.
+    // With MOD, apply address modifier from previous utc/wtc.
+    using JitHelper = unsigned (*)(Processor &cpu, unsigned reg, unsigned addr);
+    template <bool MOD, std::size_t... OPCODE>
+    static const JitHelper *jit_table(std::index_sequence<OPCODE...>);
+
+    // Code translated ahead of time, see aot.h.
+    // Used when contents of memory matches the hash.
+    Native find_aot(unsigned start, unsigned length) const;
+    uint64_t aot_count{};                 // blocks which got translated code
+    std::vector<BlockImage> *block_log{}; // record superblocks for aotgen
+
+    // Execute one opcode: overloaded for every opcode in processor.cpp.
+    // The default one handles extracodes and invalid opcodes.
+    // Without TRACE, memory accesses are not traced.
+    // Memory-reference opcodes are specialized by addressing mode.
+    template <unsigned OPCODE>
+    using Opcode = std::integral_constant<unsigned, OPCODE>;
+    template <bool TRACE, unsigned OPCODE>
+    void execute(Opcode<OPCODE>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<000>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<001>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<002>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<003>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<004>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<005>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<006>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<007>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<010>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<011>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<012>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<013>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<014>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<015>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<016>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<017>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<020>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<021>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<022>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<023>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<024>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<025>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<026>, unsigned reg, unsigned addr);
+    template <bool TRACE, AddrMode MODE = AddrMode::GENERIC>
+    void execute(Opcode<027>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<030>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<031>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<032>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<033>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<034>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<035>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<036>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<037>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<040>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<041>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<042>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<043>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<044>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<045>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<046>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<047>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0220>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0230>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0240>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0250>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0260>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0270>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0300>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0310>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0320>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0340>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0350>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0360>, unsigned reg, unsigned addr);
+    template <bool TRACE>
+    void execute(Opcode<0370>, unsigned reg, unsigned addr);
+
+    // Operand of memory-reference instruction.
+    template <bool TRACE, AddrMode MODE>
+    Word load_operand(unsigned reg, unsigned addr);
+
+    // Specialized handlers of memory-reference opcodes have their own
+    // dispatch entries, in the range of unused opcodes 0100-0173.
+    static constexpr unsigned ENTRY_BASE    = 0100;
+    static constexpr unsigned MEMORY_FIRST  = 004;
+    static constexpr unsigned MEMORY_NCODES = 024;
+    static constexpr unsigned entry_of(unsigned opcode, AddrMode mode)
+    {
+        return ENTRY_BASE + (unsigned(mode) - 1) * MEMORY_NCODES + opcode - MEMORY_FIRST;
+    }
+
+    // Prefixes utc/wtc, decoded as a pair with the next instruction,
+    // have dispatch entries 0174-0175.
+    static constexpr unsigned ENTRY_PAIR_UTC = 0174;
+    static constexpr unsigned ENTRY_PAIR_WTC = 0175;
+
+    // Execute decoded instruction by dispatch entry.
+    template <bool TRACE, unsigned ENTRY>
+    void execute_entry(unsigned reg, unsigned addr);
+
+    // Handler of decoded instruction: invoke execute() via plain function pointer.
+    // Used by step(), the reference engine, which is always traced.
+    using Handler = void (*)(Processor &cpu, unsigned reg, unsigned addr);
+    template <unsigned OPCODE>
+    static void handler(Processor &cpu, unsigned reg, unsigned addr)
+    {
+        cpu.execute<true>(Opcode<OPCODE>(), reg, addr);
+    }
+    template <std::size_t... OPCODE>
+    static const Handler *handler_table(std::index_sequence<OPCODE...>);
 
     // Extracodes.
     void extracode(unsigned opcode);
@@ -144,6 +432,9 @@ public:
     // Constructor.
     Processor(Machine &machine, Memory &memory);
 
+    // Destructor releases translated code.
+    ~Processor();
+
     // Reset to initial state.
     void reset();
 
@@ -151,6 +442,48 @@ public:
     // Return true when the processor is stopped.
     bool step();
 
+    // Engine: simulate up to the given number of instructions.
+    // Return true when the processor is stopped.
+    using Runner = bool (Processor::*)(uint64_t budget);
+
+    // Simulate up to the given number of instructions, using the given engine.
+    // Return the reason of stop: HALT, FINISH, PAUSE, LIMIT or FAULT.
+    StopReason run(Runner engine, uint64_t budget);
+
+    // Message of the exception, when run() has returned FAULT.
+    const std::string &get_fault() const { return fault; }
+
+    // Make run() return PAUSE after current instruction.
+    void request_pause() { pause = true; }
+
+    // Save and restore state of the processor and printer, see snapshot.cpp.
+    void save_state(std::ostream &out) const;
+    void restore_state(std::istream &in);
+
+    // Simulate up to the given number of instructions, calling step() for each.
+    // Stop after extracode. Return true when the processor is stopped.
+    bool run_step(uint64_t budget);
+
+    // Simulate up to the given number of instructions, using threaded dispatch.
+    // Stop after extracode. Return true when the processor is stopped.
+    // No trace is printed.
+    bool run_threaded(uint64_t budget);
+
+    // Same as run_threaded(), with trace enabled by Machine::enable_trace().
+    bool run_traced(uint64_t budget);
+
+    // Simulate up to the given number of instructions, using superblocks.
+    // Stop after extracode. Return true when the processor is stopped.
+    bool run_blocks(uint64_t budget);
+
+    // Simulate up to the given number of instructions, using superblocks
+    // translated into host code. Stop after extracode.
+    // Return true when the processor is stopped.
+    bool run_jit(uint64_t budget);
+
+    // Forget decoded instructions when memory is changed.
+    void invalidate(unsigned addr, unsigned nwords = 1);
+
     // Stack correction in case of exception.
     void stack_correction();
 
@@ -171,6 +504,37 @@ public:
     Word get_rmr() const { return core.RMR; }
     bool on_right_instruction() const { return core.right_instr_flag; }
 
+    // Tables of helpers for translated code: plain ones indexed by dispatch entry,
+    // ones which apply address modifier from previous utc/wtc - by opcode.
+    static const JitHelper *jit_helpers(bool mod);
+
+    // Helper itself: code translated ahead of time calls it directly.
+    // All instances are emitted by jit_helpers() in processor.cpp.
+    template <unsigned OPCODE, bool MOD>
+    static unsigned jit_step(Processor &cpu, unsigned reg, unsigned addr);
+
+    // Hash of memory words, covered by the given instructions.
+    uint64_t block_hash(unsigned start, unsigned length) const;
+
+    // Record every translated superblock into the log, see aotgen.cpp.
+    void record_blocks(std::vector<BlockImage> *log) { block_log = log; }
+
+    // Get count of superblocks, which got code translated ahead of time.
+    uint64_t get_aot_count() const { return aot_count; }
+
+    // Get count of skipped counting loops, and of instructions skipped.
+    uint64_t get_loop_hits() const { return loop_hits; }
+    uint64_t get_loop_skipped() const { return loop_skipped; }
+
+    // Count fused utc/wtc pairs, or not.
+    void enable_fused_count(bool on) { fused_count_enabled = on; }
+
+    // Get count of utc (prefix 0) or wtc (prefix 1), fused with the given opcode.
+    uint64_t get_fused_count(unsigned prefix, unsigned opcode) const
+    {
+        return fused_count[prefix][opcode];
+    }
+
     // Arithmetics.
     void arith_add(Word val, bool negate_acc, bool negate_val);
     void arith_normalize_and_round(MantissaExponent acc, Word mr, bool round_flag);
@@ -185,4 +549,21 @@ public:
     void print_registers();
 };
 
+//
+// Get superblock at PC.
+// Follow the chain of the previous block, when possible.
+//
+inline Processor::Block *Processor::next_block(Block *from)
+{
+    core.PC &= BITS(15);
+    if (from && !dirty_pages) {
+        unsigned start = core.PC * 2 + core.right_instr_flag;
+        if (from->chain[0] && from->chain[0]->start == start)
+            return from->chain[0];
+        if (from->chain[1] && from->chain[1]->start == start)
+            return from->chain[1];
+    }
+    return find_block(from);
+}
+
 #endif // DUBNA_PROCESSOR_H
@@ -24,16 +24,36 @@
 //
 #include "session.h"
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <cmath>
+#include <csignal>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 #include "machine.h"
 
+//
+// Fork server: reap finished jobs as soon as they exit,
+// even when the server is idle.
+//
+static void reap_jobs(int)
+{
+    int saved_errno = errno;
+    while (waitpid(-1, nullptr, WNOHANG) > 0) {
+        continue;
+    }
+    errno = saved_errno;
+}
+
 //
 // Internal implementation of the simulation session, hidden from user.
 //
@@ -48,6 +68,13 @@ private:
     // Status of the simulation.
     int exit_status{ EXIT_SUCCESS };
 
+    // Write disk overlays to images at the end of successful job.
+    bool commit_disk_overlay{};
+
+    // Snapshot of the booted monitor: file to save, or to start from.
+    std::string save_snapshot_file;
+    std::string from_snapshot_file;
+
 public:
     //
     // Instantiate the session.
@@ -91,58 +118,143 @@ public:
     {
         // Load requested ELF file.
         try {
-            std::cout << "Read job '" << job_file << "'" << std::endl;
+            machine.get_output() << "Read job '" << job_file << "'" << std::endl;
             machine.load(job_file);
 
         } catch (std::exception &ex) {
-            std::cerr << "Error: " << ex.what() << std::endl;
+            machine.get_error_output() << "Error: " << ex.what() << std::endl;
             exit_status = EXIT_FAILURE;
             return;
         }
 
         try {
-            // Boot MS Dubna by default.
-            // Mount tape image 9 as disk 30, read only.
-            // Re-direct drum 21 to it.
+            if (!from_snapshot_file.empty()) {
+                // Monitor is already booted.
+                machine.restore_snapshot(from_snapshot_file);
+            } else {
+                // Boot MS Dubna by default.
+                // Mount tape image 9 as disk 30, read only.
+                // Re-direct drum 21 to it.
+                machine.disk_mount(030, "9", false);
+                machine.map_drum_to_disk(021, 030);
+                machine.boot_ms_dubna();
+            }
+            machine.set_snapshot_file(save_snapshot_file);
+            simulate();
+            if (commit_disk_overlay) {
+                machine.commit_disk_overlays();
+            }
+
+        } catch (const std::exception &ex) {
+            // Print exception message.
+            machine.get_error_output() << "Error: " << ex.what() << std::endl;
+            exit_status = EXIT_FAILURE;
+        } catch (...) {
+            // Assuming the exception message already printed.
+            exit_status = EXIT_FAILURE;
+        }
+        sync_disks();
+    }
+
+    //
+    // Written data reach the disk images, whether the job succeeded or not.
+    // Write errors are reported with the job.
+    //
+    void sync_disks()
+    {
+        try {
+            machine.sync_disks();
+
+        } catch (const std::exception &ex) {
+            machine.get_error_output() << "Error: " << ex.what() << std::endl;
+            exit_status = EXIT_FAILURE;
+        }
+    }
+
+    //
+    // Fork server: boot MS Dubna once, then run every job
+    // received on the socket in a child process.
+    //
+    void serve(const std::string &socket_path, unsigned max_jobs)
+    {
+        try {
+            // Boot MS Dubna, up to the point where it reads the job deck.
             machine.disk_mount(030, "9", false);
             machine.map_drum_to_disk(021, 030);
             machine.boot_ms_dubna();
+            machine.run_until_deck_read();
 
-            // Run simulation.
-            using namespace std::chrono;
-            std::cout << "------------------------------------------------------------"
-                      << std::endl;
-            auto t0 = steady_clock::now();
-            machine.run();
-            auto t1 = steady_clock::now();
-
-            // Get duration in microseconds.
-            auto usec = (double)duration_cast<microseconds>(t1 - t0).count();
-            if (usec < 1)
-                usec = 1;
-
-            // Compute the simulation speed.
-            auto sec           = usec / 1000000.0;
-            auto instr_count   = Machine::get_instr_count();
-            long instr_per_sec = std::lround(1000000.0 * instr_count / usec);
-
-            // Print footer.
-            print_footer(std::cout, sec, instr_per_sec);
-
-            if (Machine::trace_enabled()) {
-                // Print also to the trace file.
-                auto &out = Machine::get_trace_stream();
-                if (&out != &std::cout) {
-                    print_footer(out, sec, instr_per_sec);
-                }
-            }
         } catch (const std::exception &ex) {
-            // Print exception message.
             std::cerr << "Error: " << ex.what() << std::endl;
             exit_status = EXIT_FAILURE;
+            return;
         } catch (...) {
-            // Assuming the exception message already printed.
             exit_status = EXIT_FAILURE;
+            return;
+        }
+
+        // Listen on the socket.
+        struct sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Error: Socket path is too long: " << socket_path << std::endl;
+            exit_status = EXIT_FAILURE;
+            return;
+        }
+        socket_path.copy(addr.sun_path, socket_path.size());
+        unlink(socket_path.c_str());
+        int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(listen_fd, 16) < 0) {
+            std::cerr << "Error: Cannot listen on " << socket_path << ": " << std::strerror(errno)
+                      << std::endl;
+            if (listen_fd >= 0)
+                close(listen_fd);
+            exit_status = EXIT_FAILURE;
+            return;
+        }
+        machine.get_output() << "Listen on '" << socket_path << "'" << std::endl;
+
+        struct sigaction reap_action {}, old_action {};
+        reap_action.sa_handler = reap_jobs;
+        reap_action.sa_flags   = SA_RESTART | SA_NOCLDSTOP;
+        sigemptyset(&reap_action.sa_mask);
+        sigaction(SIGCHLD, &reap_action, &old_action);
+
+        for (unsigned count = 0; max_jobs == 0 || count < max_jobs;) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error: Cannot accept on " << socket_path << ": "
+                          << std::strerror(errno) << std::endl;
+                exit_status = EXIT_FAILURE;
+                break;
+            }
+
+            // Child gets a copy-on-write image of the pre-booted machine.
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0) {
+                sigaction(SIGCHLD, &old_action, nullptr);
+                close(listen_fd);
+                serve_job(fd);
+            }
+            close(fd);
+            if (pid < 0) {
+                std::cerr << "Error: Cannot fork: " << std::strerror(errno) << std::endl;
+                continue;
+            }
+            count++;
+        }
+        close(listen_fd);
+        unlink(socket_path.c_str());
+
+        // Wait for the remaining jobs.
+        sigaction(SIGCHLD, &old_action, nullptr);
+        while (waitpid(-1, nullptr, 0) > 0 || errno == EINTR) {
+            continue;
         }
     }
 
@@ -153,7 +265,7 @@ public:
     void finish()
     {
         // Finish the trace output.
-        Machine::close_trace();
+        machine.close_trace();
     }
 
     //
@@ -162,15 +274,20 @@ public:
     //
     void set_verbose(bool on) { machine.set_verbose(on); }
 
+    //
+    // Select execution engine.
+    //
+    void set_engine(const std::string &name) { machine.set_engine(Machine::engine_by_name(name)); }
+
     //
     // Enable trace log to stdout.
     //
     void enable_trace(const char *mode)
     {
         if (mode && *mode) {
-            Machine::enable_trace(mode);
+            machine.enable_trace(mode);
         } else {
-            Machine::close_trace();
+            machine.close_trace();
         }
     }
 
@@ -179,8 +296,127 @@ public:
     //
     void set_trace_file(const char *filename, const char *default_mode)
     {
-        Machine::redirect_trace(filename, default_mode);
-        Machine::get_trace_stream() << "Dubna Simulator Version: " << VERSION_STRING << "\n";
+        machine.redirect_trace(filename, default_mode);
+        machine.get_trace_stream() << "Dubna Simulator Version: " << VERSION_STRING << "\n";
+    }
+
+    //
+    // Enable trace log to the given stream.
+    //
+    void set_trace_stream(std::ostream &out, const char *default_mode)
+    {
+        machine.redirect_trace(out, default_mode);
+    }
+
+    //
+    // Watch memory range.
+    //
+    void add_watchpoint(const std::string &spec) { machine.add_watchpoint(spec); }
+
+    //
+    // Mount disk image, optionally with overlay.
+    //
+    void disk_mount(unsigned disk_unit, const std::string &filename, bool write_permit)
+    {
+        machine.disk_mount(disk_unit, filename, write_permit);
+    }
+
+    void enable_disk_overlay(bool commit)
+    {
+        machine.set_disk_overlay(true);
+        commit_disk_overlay = commit;
+    }
+
+    void set_disk_sync(const std::string &mode)
+    {
+        if (mode == "none") {
+            machine.set_disk_sync(DiskSync::NONE);
+        } else if (mode == "end") {
+            machine.set_disk_sync(DiskSync::JOB_END);
+        } else {
+            char *end;
+            unsigned long interval = std::strtoul(mode.c_str(), &end, 10);
+            if (end == mode.c_str() || *end != 0 || interval == 0)
+                throw std::runtime_error("Bad disk sync mode '" + mode + "'");
+            machine.set_disk_sync(DiskSync::EVERY_N, interval);
+        }
+    }
+
+    //
+    // Map drum unit from file.
+    //
+    void drum_mount(unsigned drum_unit, const std::string &filename, bool write_permit)
+    {
+        machine.drum_mount(drum_unit, filename, write_permit);
+    }
+
+    //
+    // Send output of the job to the given stream.
+    //
+    void set_output(std::ostream &out) { machine.set_output(out); }
+    void set_error_output(std::ostream &out) { machine.set_error_output(out); }
+
+    //
+    // Get the number of simulated instructions.
+    //
+    uint64_t get_instr_count() const { return machine.get_instr_count(); }
+
+    //
+    // Share read-only disk images with other sessions.
+    //
+    void set_disk_cache(std::shared_ptr<DiskCache> cache)
+    {
+        machine.set_disk_cache(std::move(cache));
+    }
+
+    //
+    // Read disk zones through the cache.
+    //
+    void set_zone_cache(std::shared_ptr<ZoneCache> cache)
+    {
+        machine.set_zone_cache(std::move(cache));
+    }
+
+    //
+    // Enable a progress message to stderr.
+    //
+    void enable_progress_message(bool on) { machine.enable_progress_message(on); }
+
+    //
+    // Snapshot of the booted monitor.
+    //
+    void save_snapshot(const std::string &filename) { save_snapshot_file = filename; }
+    void start_from_snapshot(const std::string &filename) { from_snapshot_file = filename; }
+
+    //
+    // Incremental checkpoints.
+    //
+    void enable_checkpoints(uint64_t interval, unsigned retain)
+    {
+        machine.enable_checkpoints(interval, retain);
+    }
+    unsigned get_checkpoint_count() const { return machine.get_checkpoint_count(); }
+    uint64_t get_checkpoint_instr_count(unsigned index) const
+    {
+        return machine.get_checkpoint_instr_count(index);
+    }
+    void rollback(unsigned index) { machine.rollback(index); }
+
+    //
+    // Continue simulation after rollback.
+    //
+    void resume()
+    {
+        exit_status = EXIT_SUCCESS;
+        try {
+            simulate();
+
+        } catch (const std::exception &ex) {
+            machine.get_error_output() << "Error: " << ex.what() << std::endl;
+            exit_status = EXIT_FAILURE;
+        } catch (...) {
+            exit_status = EXIT_FAILURE;
+        }
     }
 
     //
@@ -192,7 +428,11 @@ public:
     // Backdoor access to DRAM memory.
     // No tracing.
     //
-    void mem_write(const Words &input, uint64_t addr) { memory.write_words(input, addr); }
+    void mem_write(const Words &input, uint64_t addr)
+    {
+        memory.write_words(input, addr);
+        machine.cpu.invalidate(addr, input.size());
+    }
 
     void mem_read(Words &output, unsigned nrows, uint64_t addr)
     {
@@ -200,12 +440,85 @@ public:
     }
 
 private:
+    //
+    // Run simulation, print footer.
+    //
+    void simulate()
+    {
+        using namespace std::chrono;
+        machine.get_output() << "------------------------------------------------------------"
+                             << std::endl;
+        auto count0 = machine.get_instr_count();
+        auto t0     = steady_clock::now();
+        machine.run();
+        auto t1 = steady_clock::now();
+
+        // Get duration in microseconds.
+        auto usec = (double)duration_cast<microseconds>(t1 - t0).count();
+        if (usec < 1)
+            usec = 1;
+
+        // Compute the simulation speed.
+        // When started from snapshot, the boot is not counted here.
+        auto sec           = usec / 1000000.0;
+        auto instr_count   = machine.get_instr_count() - count0;
+        long instr_per_sec = std::lround(1000000.0 * instr_count / usec);
+
+        // Print footer.
+        print_footer(machine.get_output(), sec, instr_per_sec);
+
+        if (machine.trace_enabled()) {
+            // Print also to the trace file.
+            auto &out = machine.get_trace_stream();
+            if (&out != &machine.get_output()) {
+                print_footer(out, sec, instr_per_sec);
+            }
+        }
+    }
+
+    //
+    // In child process of the fork server: read the job from the socket,
+    // run it and send output back. Never returns.
+    //
+    [[noreturn]] void serve_job(int fd)
+    {
+        // Read job until the client shuts down its side of the socket.
+        std::string job;
+        char buf[4096];
+        ssize_t nbytes;
+        while ((nbytes = read(fd, buf, sizeof(buf))) > 0) {
+            job.append(buf, nbytes);
+        }
+
+        // Both output and error messages go to the client.
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+        machine.set_output(std::cout);
+        machine.set_error_output(std::cerr);
+        try {
+            std::istringstream input(job);
+            machine.load(input);
+            machine.reread_deck();
+            simulate();
+
+        } catch (const std::exception &ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            exit_status = EXIT_FAILURE;
+        } catch (...) {
+            exit_status = EXIT_FAILURE;
+        }
+        sync_disks();
+        std::cout.flush();
+        _exit(exit_status);
+    }
+
     //
     // Print footer.
     //
-    static void print_footer(std::ostream &out, double sec, long instr_per_sec)
+    void print_footer(std::ostream &out, double sec, long instr_per_sec) const
     {
-        auto instr_count   = Machine::get_instr_count();
+        auto instr_count   = machine.get_instr_count();
         int time_precision = (sec < 1) ? 3 : (sec < 10) ? 2 : 1;
 
         out << "------------------------------------------------------------" << std::endl;
@@ -214,6 +527,56 @@ private:
         out << "      Simulated: " << instr_count << " instructions" << std::endl;
         out << "Simulation rate: " << std::fixed << instr_per_sec << " instructions/sec"
             << std::setprecision(6) << std::endl;
+        auto loop_hits = machine.cpu.get_loop_hits();
+        if (machine.get_verbose() && loop_hits > 0) {
+            out << "  Skipped loops: " << loop_hits << " loops, "
+                << machine.cpu.get_loop_skipped() << " instructions" << std::endl;
+        }
+        if (machine.get_verbose()) {
+            auto nzones = machine.get_drum_zone_count();
+            out << "     Drum zones: " << nzones << " allocated, "
+                << nzones * PAGE_NWORDS * sizeof(Word) / 1024 << " kbytes" << std::endl;
+        }
+        auto prefetch_count = machine.get_disk_prefetch_count();
+        if (machine.get_verbose() && prefetch_count > 0) {
+            auto prefetch_hits = machine.get_disk_prefetch_hits();
+            out << "  Disk prefetch: " << prefetch_count << " zones, " << prefetch_hits
+                << " used (" << prefetch_hits * 100 / prefetch_count << "%)" << std::endl;
+        }
+        if (machine.get_zone_cache()) {
+            // Only accesses by this job, while the cache may be shared.
+            auto stats = machine.get_zone_cache_stats();
+            out << "     Zone cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                << stats.evictions << " evictions" << std::endl;
+        }
+        print_fused_pairs(out);
+    }
+
+    //
+    // In verbose mode, print how many utc/wtc prefixes were fused
+    // with the next instruction, for every pair.
+    //
+    void print_fused_pairs(std::ostream &out) const
+    {
+        if (!machine.get_verbose()) {
+            return;
+        }
+        uint64_t total = 0;
+        for (unsigned prefix = 0; prefix < 2; prefix++) {
+            for (unsigned opcode = 0; opcode < 0400; opcode++) {
+                total += machine.cpu.get_fused_count(prefix, opcode);
+            }
+        }
+        out << "    Fused pairs: " << total << std::endl;
+        for (unsigned prefix = 0; prefix < 2; prefix++) {
+            for (unsigned opcode = 0; opcode < 0400; opcode++) {
+                auto count = machine.cpu.get_fused_count(prefix, opcode);
+                if (count > 0) {
+                    out << "                 " << besm6_opname(prefix ? 0230 : 0220) << ' '
+                        << besm6_opname(opcode) << ": " << count << std::endl;
+                }
+            }
+        }
     }
 };
 
@@ -260,6 +623,15 @@ void Session::run()
     internal->run();
 }
 
+//
+// Fork server: boot once, run every job received on the socket
+// in a child process. Stop after so many jobs, or never when zero.
+//
+void Session::serve(const std::string &socket_path, unsigned max_jobs)
+{
+    internal->serve(socket_path, max_jobs);
+}
+
 //
 // Finish simulation.
 //
@@ -281,6 +653,70 @@ void Session::set_trace_file(const char *filename, const char *default_mode)
     internal->set_trace_file(filename, default_mode);
 }
 
+//
+// Enable a trace log to the given stream.
+//
+void Session::set_trace_stream(std::ostream &out, const char *default_mode)
+{
+    internal->set_trace_stream(out, default_mode);
+}
+
+//
+// Watch memory range, log hits to the trace.
+//
+void Session::add_watchpoint(const std::string &spec)
+{
+    internal->add_watchpoint(spec);
+}
+
+//
+// Mount disk image.
+//
+void Session::disk_mount(unsigned disk_unit, const std::string &filename, bool write_permit)
+{
+    internal->disk_mount(disk_unit, filename, write_permit);
+}
+
+//
+// Keep changes of writable disks in overlay.
+//
+void Session::enable_disk_overlay(bool commit)
+{
+    internal->enable_disk_overlay(commit);
+}
+
+//
+// Select when writes to disk images are flushed to storage.
+//
+void Session::set_disk_sync(const std::string &mode)
+{
+    internal->set_disk_sync(mode);
+}
+
+//
+// Map drum unit from file.
+//
+void Session::drum_mount(unsigned drum_unit, const std::string &filename, bool write_permit)
+{
+    internal->drum_mount(drum_unit, filename, write_permit);
+}
+
+//
+// Send output of the job to the given stream, instead of stdout.
+//
+void Session::set_output(std::ostream &out)
+{
+    internal->set_output(out);
+}
+
+//
+// Send error messages to the given stream, instead of stderr.
+//
+void Session::set_error_output(std::ostream &out)
+{
+    internal->set_error_output(out);
+}
+
 //
 // Enable verbose mode.
 //
@@ -289,6 +725,14 @@ void Session::set_verbose(bool on)
     internal->set_verbose(on);
 }
 
+//
+// Select execution engine.
+//
+void Session::set_engine(const std::string &name)
+{
+    internal->set_engine(name);
+}
+
 //
 // Fail after the specified number of instructions.
 //
@@ -310,7 +754,92 @@ uint64_t Session::get_default_limit()
 //
 uint64_t Session::get_instr_count()
 {
-    return Machine::get_instr_count();
+    return internal->get_instr_count();
+}
+
+//
+// Share read-only disk images with other sessions.
+//
+void Session::set_disk_cache(std::shared_ptr<DiskCache> cache)
+{
+    internal->set_disk_cache(std::move(cache));
+}
+
+//
+// Read disk zones through the cache shared with other sessions.
+//
+void Session::set_zone_cache(std::shared_ptr<ZoneCache> cache)
+{
+    internal->set_zone_cache(std::move(cache));
+}
+
+//
+// Read disk zones through a private cache of the given size.
+//
+void Session::enable_zone_cache(size_t nbytes)
+{
+    internal->set_zone_cache(std::make_shared<ZoneCache>(nbytes));
+}
+
+//
+// Enable a progress message to stderr.
+//
+void Session::enable_progress_message(bool on)
+{
+    internal->enable_progress_message(on);
+}
+
+//
+// Save state of the booted monitor to file, while running the job.
+//
+void Session::save_snapshot(const std::string &filename)
+{
+    internal->save_snapshot(filename);
+}
+
+//
+// Start the job from saved state, instead of booting the monitor.
+//
+void Session::start_from_snapshot(const std::string &filename)
+{
+    internal->start_from_snapshot(filename);
+}
+
+//
+// Take a checkpoint every so many instructions, keep the most recent ones.
+//
+void Session::enable_checkpoints(uint64_t interval, unsigned retain)
+{
+    internal->enable_checkpoints(interval, retain);
+}
+
+//
+// Query the checkpoints.
+//
+unsigned Session::get_checkpoint_count()
+{
+    return internal->get_checkpoint_count();
+}
+
+uint64_t Session::get_checkpoint_instr_count(unsigned index)
+{
+    return internal->get_checkpoint_instr_count(index);
+}
+
+//
+// Restore state of the machine from the checkpoint.
+//
+void Session::rollback(unsigned index)
+{
+    internal->rollback(index);
+}
+
+//
+// Continue simulation after rollback.
+//
+void Session::resume()
+{
+    internal->resume();
 }
 
 //
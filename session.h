@@ -25,11 +25,15 @@
 #ifndef DUBNA_SESSION_H
 #define DUBNA_SESSION_H
 
+#include <iosfwd>
 #include <memory>
 #include <string>
 
 #include "besm6_arch.h"
 
+class DiskCache;
+class ZoneCache;
+
 //
 // External interface to the simulator.
 //
@@ -46,6 +50,12 @@ public:
     // Run simulation session with given parameters.
     void run();
 
+    // Fork server: boot MS Dubna once, then listen on the UNIX socket.
+    // For every connection, read a job until end of input, and run it
+    // in a child process, forked from the booted state. Output goes back
+    // to the socket. Stop after so many jobs, or never when zero.
+    void serve(const std::string &socket_path, unsigned max_jobs = 0);
+
     // Finish simulation.
     void finish();
 
@@ -57,16 +67,87 @@ public:
     void set_limit(uint64_t count);
     static uint64_t get_default_limit();
 
+    // Select execution engine: "step" or "threaded".
+    // Throw exception on unknown name.
+    void set_engine(const std::string &name);
+
     // Enable verbose mode: print more details to the trace log.
     void set_verbose(bool on = true);
 
-    // Enable a trace log to stdout or to the specified file.
+    // Enable a trace log to stdout, to the specified file or to the given stream.
     void enable_trace(const char *mode);
     void set_trace_file(const char *filename, const char *default_mode);
+    void set_trace_stream(std::ostream &out, const char *default_mode);
+
+    // Watch memory range, given as ADDR[:LEN][:MODE] in octal, where mode is
+    // any of r (read), w (write), x (fetch), and s to stop on hit.
+    // Hits are logged to the trace. Throw exception on bad spec.
+    void add_watchpoint(const std::string &spec);
+
+    // Map drum unit from file, instead of memory: contents persist across runs.
+    // Read-only file is shared, and changes made by the job are discarded.
+    // Throw exception when the file cannot be mapped.
+    void drum_mount(unsigned drum_unit, const std::string &filename, bool write_permit = true);
+
+    // Mount disk image: unit is 030...067.
+    // Throw exception when the file cannot be opened.
+    void disk_mount(unsigned disk_unit, const std::string &filename, bool write_permit);
+
+    // Mount writable disks with overlay: images are opened read-only, and shared
+    // with other sessions. Modified zones are kept in memory. When the job succeeds,
+    // write them to the images if commit is true, otherwise discard.
+    // Must be called before disk_mount().
+    void enable_disk_overlay(bool commit);
+
+    // Flush writes to disk images: mode is "none", "end" for the end of job,
+    // or a number of write transfers between flushes.
+    // Throw exception on bad mode. Must be called before disk_mount().
+    void set_disk_sync(const std::string &mode);
+
+    // Send output of the job to the given stream, instead of stdout.
+    // The stream must outlive the session.
+    void set_output(std::ostream &out);
+
+    // Send error messages of the job to the given stream, instead of stderr.
+    // The stream must outlive the session.
+    void set_error_output(std::ostream &out);
 
     // Get the number of simulated instructions.
     uint64_t get_instr_count();
 
+    // Share read-only disk images with other sessions.
+    void set_disk_cache(std::shared_ptr<DiskCache> cache);
+
+    // Read disk zones through a cache, shared with other sessions,
+    // or private one with the given budget in bytes.
+    void set_zone_cache(std::shared_ptr<ZoneCache> cache);
+    void enable_zone_cache(size_t nbytes);
+
+    // Enable a progress message to stderr.
+    void enable_progress_message(bool on);
+
+    // Save state of the booted monitor to file, while running the job.
+    void save_snapshot(const std::string &filename);
+
+    // Start the job from saved state, instead of booting the monitor.
+    void start_from_snapshot(const std::string &filename);
+
+    // Take a checkpoint in memory every so many instructions, while running
+    // the job. Keep the given number of most recent checkpoints.
+    // Only pages and drum zones modified since the previous checkpoint are copied.
+    void enable_checkpoints(uint64_t interval, unsigned retain = 8);
+
+    // Checkpoints available, from oldest to newest, and their instruction counts.
+    unsigned get_checkpoint_count();
+    uint64_t get_checkpoint_instr_count(unsigned index);
+
+    // Roll back to the checkpoint, dropping the later ones.
+    // Output printed after the checkpoint is not undone.
+    void rollback(unsigned index);
+
+    // Continue simulation after rollback, for example with trace enabled.
+    void resume();
+
     // Get version of the simulator.
     static const char *get_version();
 
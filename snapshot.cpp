@@ -0,0 +1,253 @@
+//
+// Snapshot of the machine state: warm start of jobs with the monitor already booted.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "machine.h"
+
+//
+// Snapshot file starts with magic word and version.
+// Increment version on every change of the format.
+//
+static const char SNAPSHOT_MAGIC[8]    = { 'D', 'u', 'b', 'n', 'a', 'S', 'n', 'p' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const unsigned DRUM_NWORDS      = 040 * PAGE_NWORDS;
+
+//
+// Write value in binary form.
+//
+template <typename T>
+static void put(std::ostream &out, const T &val)
+{
+    out.write(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+static void put(std::ostream &out, const std::string &str)
+{
+    put(out, (uint32_t)str.size());
+    out.write(str.data(), str.size());
+}
+
+//
+// Read value in binary form.
+// Throw exception when file is too short.
+//
+template <typename T>
+static void get(std::istream &in, T &val)
+{
+    in.read(reinterpret_cast<char *>(&val), sizeof(val));
+    if (!in)
+        throw std::runtime_error("Snapshot is truncated");
+}
+
+static void get(std::istream &in, std::string &str)
+{
+    uint32_t size;
+    get(in, size);
+    str.resize(size);
+    in.read(str.data(), size);
+    if (!in)
+        throw std::runtime_error("Snapshot is truncated");
+}
+
+//
+// Save state of the processor and printer.
+//
+void Processor::save_state(std::ostream &out) const
+{
+    put(out, core);
+    put(out, RK);
+    put(out, next_mod);
+
+    put(out, e64_line);
+    put(out, e64_skip_lines);
+    put(out, e64_position);
+    put(out, e64_line_count);
+    put(out, e64_line_dirty);
+    put(out, e64_overprint);
+}
+
+//
+// Restore state of the processor and printer.
+//
+void Processor::restore_state(std::istream &in)
+{
+    get(in, core);
+    get(in, RK);
+    get(in, next_mod);
+
+    get(in, e64_line);
+    get(in, e64_skip_lines);
+    get(in, e64_position);
+    get(in, e64_line_count);
+    get(in, e64_line_dirty);
+    get(in, e64_overprint);
+}
+
+//
+// Save state of the machine to file.
+// Drum 1 holds the job deck, so it's not saved.
+//
+void Machine::save_snapshot(const std::string &filename)
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+        throw std::runtime_error("Cannot write to " + filename);
+
+    out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put(out, SNAPSHOT_VERSION);
+
+    // Mounted disk images, with hashes of their contents.
+    uint32_t ndisks = 0;
+    for (auto &disk : disks) {
+        if (disk)
+            ndisks++;
+    }
+    put(out, ndisks);
+    for (unsigned i = 0; i < NDISKS; i++) {
+        if (disks[i]) {
+            put(out, (uint32_t)(i + 030));
+            put(out, disks[i]->is_writable());
+            put(out, disks[i]->get_path());
+            put(out, disks[i]->get_hash());
+        }
+    }
+    put(out, mapped_drum);
+    put(out, mapped_disk);
+
+    put(out, simulated_instructions);
+    put(out, deck_read);
+    put(out, boot_capture.str());
+    cpu.save_state(out);
+    out.write(reinterpret_cast<const char *>(memory.get_ptr(0)), MEMORY_NWORDS * sizeof(Word));
+
+    // Contents of drums. Drums mapped from files keep their contents there.
+    auto saved = [this](unsigned i) {
+        return drums[i] && i != 1 && !drums[i]->is_file_backed();
+    };
+    uint32_t ndrums = 0;
+    for (unsigned i = 0; i < NDRUMS; i++) {
+        if (saved(i))
+            ndrums++;
+    }
+    put(out, ndrums);
+    for (unsigned i = 0; i < NDRUMS; i++) {
+        if (saved(i)) {
+            put(out, (uint32_t)i);
+            for (unsigned zone = 0; zone < Drum::NZONES; zone++) {
+                out.write(reinterpret_cast<const char *>(drums[i]->get_zone(zone)),
+                          PAGE_NWORDS * sizeof(Word));
+            }
+        }
+    }
+
+    if (!out)
+        throw std::runtime_error("Cannot write to " + filename);
+}
+
+//
+// Restore state of the machine from file, instead of booting the monitor.
+// Job deck must be already loaded to drum 1:
+// repeat the first read of it, made by the monitor.
+//
+void Machine::restore_snapshot(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open())
+        throw std::runtime_error("Cannot read " + filename);
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+        throw std::runtime_error(filename + ": Not a snapshot");
+
+    uint32_t version;
+    get(in, version);
+    if (version != SNAPSHOT_VERSION)
+        throw std::runtime_error(filename + ": Unsupported snapshot version " +
+                                 std::to_string(version));
+
+    // Mount the same disk images, and make sure they have not changed.
+    uint32_t ndisks;
+    get(in, ndisks);
+    for (unsigned i = 0; i < ndisks; i++) {
+        uint32_t disk_unit;
+        bool write_permit;
+        std::string path;
+        uint64_t hash;
+        get(in, disk_unit);
+        get(in, write_permit);
+        get(in, path);
+        get(in, hash);
+
+        disk_mount(disk_unit, path, write_permit);
+        if (disks[disk_unit - 030]->get_hash() != hash)
+            throw std::runtime_error("Disk image " + path + " has changed since snapshot");
+    }
+    unsigned drum, disk;
+    get(in, drum);
+    get(in, disk);
+    map_drum_to_disk(drum, disk);
+
+    get(in, simulated_instructions);
+    get(in, deck_read);
+    get(in, boot_printout);
+    cpu.restore_state(in);
+    in.read(reinterpret_cast<char *>(memory.get_ptr(0)), MEMORY_NWORDS * sizeof(Word));
+    if (!in)
+        throw std::runtime_error("Snapshot is truncated");
+    memory.mark_dirty(0, MEMORY_NWORDS);
+    cpu.invalidate(0, MEMORY_NWORDS);
+
+    // Contents of drums.
+    uint32_t ndrums;
+    get(in, ndrums);
+    std::vector<Word> media(DRUM_NWORDS);
+    for (unsigned i = 0; i < ndrums; i++) {
+        uint32_t drum_unit;
+        get(in, drum_unit);
+        if (drum_unit >= NDRUMS || drum_unit == 1)
+            throw std::runtime_error(filename + ": Bad drum unit in snapshot");
+
+        in.read(reinterpret_cast<char *>(media.data()), DRUM_NWORDS * sizeof(Word));
+        if (!in)
+            throw std::runtime_error("Snapshot is truncated");
+
+        // Zones of zeros are left unallocated.
+        drum_init(drum_unit);
+        if (drums[drum_unit]->is_file_backed())
+            continue;
+        for (unsigned zone = 0; zone < Drum::NZONES; zone++) {
+            auto data = &media[zone * PAGE_NWORDS];
+            if (std::any_of(data, data + PAGE_NWORDS, [](Word w) { return w != 0; })) {
+                drums[drum_unit]->write_zone(zone, data);
+            }
+        }
+    }
+
+    // Monitor has just read the first page of the job deck.
+    reread_deck();
+}
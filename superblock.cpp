@@ -0,0 +1,280 @@
+//
+// Superblocks: straight-line runs of decoded instructions.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <algorithm>
+#include <cstring>
+
+#include "aot.h"
+#include "machine.h"
+
+//
+// Limit length of superblock, in instructions.
+//
+static const unsigned MAX_BLOCK_LENGTH = 256;
+
+//
+// Check whether the instruction ends a superblock:
+// it can change PC, stop the processor or call extracode.
+//
+static bool is_block_end(unsigned opcode)
+{
+    switch (opcode) {
+    case 0260: // по, uza
+    case 0270: // пе, u1a
+    case 0300: // пб, uj
+    case 0310: // пв, vjm
+    case 0330: // стоп, stop
+    case 0340: // пио, vzm
+    case 0350: // пино, v1m
+    case 0360: // э36, *36
+    case 0370: // цикл, vlm
+        return true;
+    }
+    return is_extracode(opcode);
+}
+
+//
+// Check whether the instruction modifies address of the next one.
+//
+static bool is_prefix(unsigned opcode)
+{
+    return opcode == 0220 || opcode == 0230; // мода, utc and мод, wtc
+}
+
+//
+// Translate instructions from the given start (PC*2 + right_instr_flag)
+// up to the end of superblock.
+//
+Processor::Block *Processor::translate_block(unsigned start)
+{
+    unsigned addr = start / 2;
+    bool right    = start & 1;
+    unsigned length;
+    for (length = 1;; length++) {
+        Instruction &ins = decoded[addr * 2 + right];
+        if (!ins.handler) {
+            decode(addr);
+        }
+        block_words[addr] = 1;
+
+        if (length == 1 || (addr % PAGE_NWORDS == 0 && !right)) {
+            // Register the block in every page it covers.
+            page_blocks[addr / PAGE_NWORDS].push_back(start);
+        }
+
+        if (is_block_end(ins.opcode)) {
+            break;
+        }
+        if (length >= MAX_BLOCK_LENGTH && !(length == MAX_BLOCK_LENGTH && is_prefix(ins.opcode))) {
+            // Long block: don't separate utc/wtc from the next instruction.
+            break;
+        }
+        if (right) {
+            addr++;
+            if (addr >= MEMORY_NWORDS) {
+                // Don't wrap around the end of memory.
+                break;
+            }
+        }
+        right = !right;
+    }
+
+    Block &block   = block_map[start];
+    block.start    = start;
+    block.length   = length;
+    block.loop_reg = loop_register(start, length);
+
+    if (block_log) {
+        // Record the block for aotgen.
+        block_log->push_back({ start,
+                               std::vector<Instruction>(&decoded[start], &decoded[start + length]),
+                               block_hash(start, length) });
+    }
+    if (aot_nblocks > 0) {
+        block.native = find_aot(start, length);
+        if (block.native) {
+            aot_count++;
+        }
+    }
+    return &block;
+}
+
+//
+// Compute hash of memory words, covered by the given instructions (FNV-1a).
+//
+uint64_t Processor::block_hash(unsigned start, unsigned length) const
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (unsigned addr = start / 2; addr <= (start + length - 1) / 2; addr++) {
+        Word word = memory.load(addr);
+        for (unsigned i = 0; i < 48; i += 8) {
+            hash ^= (word >> i) & 0xff;
+            hash *= 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+//
+// Find code translated ahead of time for the superblock.
+// Check that memory still has the same contents as at build time.
+// Return nullptr when not found.
+//
+Processor::Native Processor::find_aot(unsigned start, unsigned length) const
+{
+    auto first = std::lower_bound(
+        &aot_blocks[0], &aot_blocks[aot_nblocks], start,
+        [](const AotBlock &b, unsigned s) { return b.start < s; });
+    uint64_t hash = 0;
+    for (auto b = first; b != &aot_blocks[aot_nblocks] && b->start == start; b++) {
+        if (b->length != length) {
+            continue;
+        }
+        if (hash == 0) {
+            hash = block_hash(start, length);
+        }
+        if (b->hash == hash) {
+            return b->code;
+        }
+    }
+    return nullptr;
+}
+
+//
+// Check whether the superblock is a counting loop: it ends with vlm,
+// which jumps back to the start, and the body only loads the accumulator
+// or sets other index registers. Every iteration overwrites the results
+// of the previous one, so all iterations but the last can be skipped.
+// Return the loop register, or 0 when it's not such a loop.
+//
+// Polling loops around extracodes, like e57 03, are not recognized:
+// extracode ends the superblock, and its result depends on the state
+// of devices, so iterations cannot be skipped in closed form.
+// Neither are endless spins by uj to itself, which have no counter.
+//
+unsigned Processor::loop_register(unsigned start, unsigned length) const
+{
+    const Instruction &vlm = decoded[start + length - 1];
+    if (vlm.opcode != 0370 || vlm.reg == 0 || start % 2 != 0 || vlm.addr != start / 2) {
+        return 0;
+    }
+    for (unsigned k = 0; k < length - 1; k++) {
+        const Instruction &ins = decoded[start + k];
+        switch (ins.opcode) {
+        case 010: // сч, xta
+            if (ins.addr == 0 && ins.reg == 017) {
+                // Pop from stack.
+                return 0;
+            }
+            break;
+        case 0240: // уиа, vtm
+            if (ins.reg == vlm.reg) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+        }
+    }
+    return vlm.reg;
+}
+
+//
+// When counting loop has jumped back to the start, skip iterations
+// up to the last one, which is executed as usual.
+// Return the number of skipped instructions, not more than the budget.
+//
+uint64_t Processor::skip_loop(const Block *block, uint64_t budget)
+{
+    unsigned reg = block->loop_reg;
+    if (core.M[reg] == 0 || core.PC * 2 + core.right_instr_flag != block->start) {
+        // Loop is finished.
+        return 0;
+    }
+    if (machine.watching_reads()) {
+        // Skipped iterations would miss the watched reads.
+        return 0;
+    }
+
+    // Register is incremented by every iteration, until it becomes zero.
+    uint64_t iterations = std::min<uint64_t>(0100000 - core.M[reg], budget / block->length);
+    uint64_t count      = iterations * block->length;
+    if (count == 0) {
+        return 0;
+    }
+    core.M[reg] = ADDR(core.M[reg] + iterations);
+    machine.add_simulated_instructions(count);
+    loop_hits++;
+    loop_skipped += count;
+    return count;
+}
+
+//
+// Find or translate superblock at PC, and chain it to the previous one.
+// First, flush superblocks which were overwritten.
+//
+Processor::Block *Processor::find_block(Block *from)
+{
+    if (dirty_pages) {
+        flush_blocks(dirty_pages);
+        from = nullptr;
+    }
+
+    unsigned start = core.PC * 2 + core.right_instr_flag;
+    Block *block   = &block_map[start];
+    if (!block->length) {
+        // Fetch can raise exception: no stack correction yet.
+        corr_stack = 0;
+        block      = translate_block(start);
+    }
+    if (from) {
+        // Keep two recent successors.
+        from->chain[from->chain[0] ? 1 : 0] = block;
+    }
+    return block;
+}
+
+//
+// Forget superblocks in the given pages.
+// Chains of remaining blocks are cleared, to be rebuilt on the go.
+//
+void Processor::flush_blocks(uint32_t page_mask)
+{
+    for (unsigned page = 0; page < MEMORY_NWORDS / PAGE_NWORDS; page++) {
+        auto &list = page_blocks[page];
+        if (page_mask & (1u << page)) {
+            for (auto start : list) {
+                block_map[start] = {};
+            }
+            list.clear();
+            std::memset(&block_words[page * PAGE_NWORDS], 0, PAGE_NWORDS);
+        }
+    }
+    for (auto const &list : page_blocks) {
+        for (auto start : list) {
+            block_map[start].chain[0] = nullptr;
+            block_map[start].chain[1] = nullptr;
+        }
+    }
+    dirty_pages &= ~page_mask;
+}
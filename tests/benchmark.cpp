@@ -0,0 +1,88 @@
+//
+// Measure simulation speed: run a job several times and print instructions/sec.
+//
+// Copyright (c) 2023 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "session.h"
+
+//
+// Usage:
+//      benchmark [job.dub [repeat [engine]]]
+//
+// By default, run examples/fortran.dub 20 times with default engine.
+//
+int main(int argc, char *argv[])
+{
+    std::string job_file = (argc > 1) ? argv[1] : TEST_DIR "/../examples/fortran.dub";
+    unsigned repeat      = (argc > 2) ? std::stoul(argv[2]) : 20;
+    std::string engine   = (argc > 3) ? argv[3] : "";
+
+    // Set path to the disk images, unless given by user.
+    setenv("BESM6_PATH", TEST_DIR "/../tapes", 0);
+
+    uint64_t instr_count = 0;
+    double sec           = 0;
+    double best_rate     = 0;
+    for (unsigned i = 0; i < repeat; i++) {
+        Session session;
+        session.set_job_file(job_file);
+        if (!engine.empty()) {
+            session.set_engine(engine);
+        }
+
+        // Hide output of the job.
+        std::ostringstream output;
+        session.set_output(output);
+
+        auto count0 = session.get_instr_count();
+        auto t0     = std::chrono::steady_clock::now();
+        session.run();
+        auto t1 = std::chrono::steady_clock::now();
+
+        if (session.get_exit_status() != EXIT_SUCCESS) {
+            std::cerr << "Job " << job_file << " failed" << std::endl;
+            return EXIT_FAILURE;
+        }
+        auto run_count = session.get_instr_count() - count0;
+        auto run_sec   = std::chrono::duration<double>(t1 - t0).count();
+        instr_count += run_count;
+        sec += run_sec;
+        best_rate = std::max(best_rate, run_count / run_sec);
+    }
+
+    std::cout << "            Job: " << job_file << std::endl;
+    std::cout << "           Runs: " << repeat << std::endl;
+    if (!engine.empty()) {
+        std::cout << "         Engine: " << engine << std::endl;
+    }
+    std::cout << "      Simulated: " << instr_count << " instructions" << std::endl;
+    std::cout << "   Elapsed time: " << sec << " seconds" << std::endl;
+    std::cout << "Simulation rate: " << (uint64_t)(instr_count / sec) << " instructions/sec"
+              << std::endl;
+    std::cout << "      Best rate: " << (uint64_t)best_rate << " instructions/sec" << std::endl;
+    return EXIT_SUCCESS;
+}
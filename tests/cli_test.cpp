@@ -22,6 +22,7 @@
 // SOFTWARE.
 //
 #include <cstdio>
+#include <filesystem>
 #include <fstream>
 
 #include "util.h"
@@ -108,3 +109,95 @@ TEST(cli, trace_end_file)
     EXPECT_STREQ(trace[2].c_str(), "      Drum 21 PhysRead [00000-00377] = Zone 1 Sector 2");
     EXPECT_STREQ(trace[trace.size() - 5].c_str(), "00020 L: 00 074 0000 *74");
 }
+
+TEST(cli, bad_engine)
+{
+    // Run simulator via shell.
+    FILE *pipe = popen("../dubna --engine=foo job.dub 2>&1", "r");
+    ASSERT_TRUE(pipe != nullptr);
+
+    // Capture the output.
+    std::string result = stream_contents(pipe);
+    std::cout << result;
+
+    // Check exit code.
+    int exit_status = pclose(pipe);
+    int exit_code   = WEXITSTATUS(exit_status);
+    ASSERT_NE(exit_status, -1);
+    ASSERT_EQ(exit_code, 1);
+
+    // Check output.
+    EXPECT_NE(result.find("Bad --engine option: foo"), std::string::npos);
+}
+
+TEST(cli, batch)
+{
+    // Two jobs in a directory, and a missing job in manifest.
+    std::string dir_name = get_test_name() + ".dir";
+    std::filesystem::remove_all(dir_name);
+    std::filesystem::create_directory(dir_name);
+    create_file(dir_name + "/first.dub",
+                "*name first\n"
+                "*end file\n");
+    create_file(dir_name + "/second.dub",
+                "*name second\n"
+                "*end file\n");
+    create_file(dir_name + "/jobs.lst", dir_name + "/missing.dub\n");
+    std::string command_line =
+        "../dubna --batch -j 2 --debug=e " + dir_name + " @" + dir_name + "/jobs.lst";
+
+    // Set path to the disk images.
+    EXPECT_EQ(setenv("BESM6_PATH", TEST_DIR "/../tapes", 1), 0);
+
+    // Run simulator via shell.
+    FILE *pipe = popen(command_line.c_str(), "r");
+    ASSERT_TRUE(pipe != nullptr);
+
+    // Capture the output.
+    std::string result = stream_contents(pipe);
+    std::cout << result;
+
+    // Check exit code: one job failed.
+    int exit_status = pclose(pipe);
+    int exit_code   = WEXITSTATUS(exit_status);
+    ASSERT_NE(exit_status, -1);
+    ASSERT_EQ(exit_code, 1);
+
+    // Check summary.
+    EXPECT_NE(result.find("Jobs: 3 on 2 threads"), std::string::npos);
+    EXPECT_NE(result.find("Failed: 1 jobs"), std::string::npos);
+    EXPECT_NE(result.find("missing.dub"), std::string::npos);
+
+    // Check output and status of every job.
+    EXPECT_NE(file_contents(dir_name + "/first.out").find("Read job '" + dir_name + "/first.dub'"),
+              std::string::npos);
+    EXPECT_NE(file_contents(dir_name + "/second.out").find("Read job '" + dir_name + "/second.dub'"),
+              std::string::npos);
+    EXPECT_EQ(file_contents(dir_name + "/first.status"), "0\n");
+    EXPECT_EQ(file_contents(dir_name + "/second.status"), "0\n");
+    EXPECT_EQ(file_contents(dir_name + "/missing.status"), "1\n");
+
+    // Trace of extracodes and error messages go to output of the job.
+    EXPECT_NE(file_contents(dir_name + "/first.out").find("*74"), std::string::npos);
+    EXPECT_NE(file_contents(dir_name + "/missing.out").find("Error:"), std::string::npos);
+}
+
+TEST(cli, batch_trace_file)
+{
+    // Run simulator via shell.
+    FILE *pipe = popen("../dubna --batch --trace=batch.trace job.dub 2>&1", "r");
+    ASSERT_TRUE(pipe != nullptr);
+
+    // Capture the output.
+    std::string result = stream_contents(pipe);
+    std::cout << result;
+
+    // Check exit code.
+    int exit_status = pclose(pipe);
+    int exit_code   = WEXITSTATUS(exit_status);
+    ASSERT_NE(exit_status, -1);
+    ASSERT_EQ(exit_code, 1);
+
+    // Check output.
+    EXPECT_NE(result.find("Option --trace cannot be used with --batch"), std::string::npos);
+}
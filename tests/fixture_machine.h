@@ -35,6 +35,9 @@ class dubna_machine : public ::testing::Test {
     Memory memory;
     std::mt19937 random_generator;
 
+    // Files created by the test, removed at the end.
+    std::vector<std::string> temp_files;
+
 protected:
     std::unique_ptr<Machine> machine;
 
@@ -43,9 +46,32 @@ protected:
         // Allocate fresh new Machine.
         machine = std::make_unique<Machine>(memory);
 
+        // Select execution engine, when requested.
+        if (auto engine = getenv("DUBNA_ENGINE")) {
+            machine->set_engine(Machine::engine_by_name(engine));
+        }
+
         // Reset the random generator.
         random_generator.seed(0);
     }
 
+    void TearDown() override
+    {
+        for (auto &filename : temp_files) {
+            std::remove(filename.c_str());
+        }
+    }
+
     void store_word(unsigned addr, uint64_t val) { machine->memory.store(addr, val); }
+
+    // Create empty disk image with so many zones, plus zones reserved by OS.
+    // Return the file name, with a slash to avoid search by Machine::disk_find().
+    std::string create_disk_image(unsigned nzones)
+    {
+        std::string filename = "./" + get_test_name() + ".bin";
+        size_t nbytes        = (DISK_ZONE_OFFSET + nzones) * DISK_ZONE_NWORDS * sizeof(Word);
+        create_file(filename, std::string(nbytes, '\0'));
+        temp_files.push_back(filename);
+        return filename;
+    }
 };
@@ -39,6 +39,11 @@ protected:
         // Allocate fresh new Session.
         session = std::make_unique<Session>();
 
+        // Select execution engine, when requested.
+        if (auto engine = getenv("DUBNA_ENGINE")) {
+            session->set_engine(engine);
+        }
+
         // Set path to the disk images.
         EXPECT_EQ(setenv("BESM6_PATH", TEST_DIR "/../tapes", 1), 0);
     }
@@ -53,16 +58,14 @@ protected:
         create_file(job_filename, input);
         session->set_job_file(job_filename);
 
-        // Redirect stdout.
-        std::streambuf *save_cout = std::cout.rdbuf();
+        // Capture output of the job.
         std::ostringstream output;
-        std::cout.rdbuf(output.rdbuf());
+        session->set_output(output);
 
         // Run the job.
         session->run();
 
         // Return output.
-        std::cout.rdbuf(save_cout);
         return output.str();
     }
 
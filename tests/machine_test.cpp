@@ -23,6 +23,7 @@
 //
 #include <fstream>
 
+#include "aot.h"
 #include "fixture_machine.h"
 
 TEST_F(dubna_machine, trace_arx)
@@ -154,3 +155,630 @@ TEST_F(dubna_machine, trace_startjob)
     auto expect = file_contents(TEST_DIR "/trace_startjob.expect");
     EXPECT_EQ(trace, expect);
 }
+
+//
+// Run the same code with all engines: results must match.
+//
+TEST_F(dubna_machine, engine_step_vs_threaded)
+{
+    // Store the test code.
+    store_word(010, besm6_asm("уиа -100(2), сч 2000"));
+    store_word(011, besm6_asm("мода 1(2), слц 2001(2)"));
+    store_word(012, besm6_asm("зп 2002, цикл 11(2)"));
+    store_word(013, besm6_asm("пв 15(3), мода"));
+    store_word(014, besm6_asm("стоп 12345(6), мода")); // Magic opcode: Pass
+    store_word(015, besm6_asm("уиа 3(4), пб (3)"));
+    store_word(02000, 0'0000'0000'0000'0001ul);
+
+    // Run with reference engine.
+    machine->set_engine(Machine::Engine::STEP);
+    machine->cpu.set_pc(010);
+    auto count0 = machine->get_instr_count();
+    machine->run();
+    auto step_count = machine->get_instr_count() - count0;
+    auto step_acc   = machine->cpu.get_acc();
+    EXPECT_EQ(machine->cpu.get_pc(), 014u);
+
+    // Run again with threaded engine.
+    machine->cpu.reset();
+    machine->set_engine(Machine::Engine::THREADED);
+    machine->cpu.set_pc(010);
+    count0 = machine->get_instr_count();
+    machine->run();
+    EXPECT_EQ(machine->get_instr_count() - count0, step_count);
+    EXPECT_EQ(machine->cpu.get_acc(), step_acc);
+    EXPECT_EQ(machine->cpu.get_pc(), 014u);
+    EXPECT_EQ(machine->cpu.get_m(3), 014u);
+    EXPECT_EQ(machine->cpu.get_m(4), 3u);
+
+    // Run again with superblocks.
+    machine->cpu.reset();
+    machine->set_engine(Machine::Engine::BLOCK);
+    machine->cpu.set_pc(010);
+    count0 = machine->get_instr_count();
+    machine->run();
+    EXPECT_EQ(machine->get_instr_count() - count0, step_count);
+    EXPECT_EQ(machine->cpu.get_acc(), step_acc);
+    EXPECT_EQ(machine->cpu.get_pc(), 014u);
+    EXPECT_EQ(machine->cpu.get_m(3), 014u);
+    EXPECT_EQ(machine->cpu.get_m(4), 3u);
+
+    // Run again with translated superblocks.
+    machine->cpu.reset();
+    machine->set_engine(Machine::Engine::JIT);
+    machine->cpu.set_pc(010);
+    count0 = machine->get_instr_count();
+    machine->run();
+    EXPECT_EQ(machine->get_instr_count() - count0, step_count);
+    EXPECT_EQ(machine->cpu.get_acc(), step_acc);
+    EXPECT_EQ(machine->cpu.get_pc(), 014u);
+    EXPECT_EQ(machine->cpu.get_m(3), 014u);
+    EXPECT_EQ(machine->cpu.get_m(4), 3u);
+}
+
+//
+// Superblock engine: overwrite the code which is being executed.
+//
+TEST_F(dubna_machine, engine_block_self_modifying)
+{
+    // Store the test code.
+    store_word(010, besm6_asm("сч 2000, зп 11"));
+    store_word(011, besm6_asm("сч 2001, мода"));
+    store_word(012, besm6_asm("стоп 12345(6), мода")); // Magic opcode: Pass
+    store_word(02000, besm6_asm("сч 2002, мода"));
+    store_word(02001, 0'1111'1111'1111'1111ul);
+    store_word(02002, 0'2222'2222'2222'2222ul);
+
+    // Run with reference engine.
+    machine->set_engine(Machine::Engine::STEP);
+    machine->cpu.set_pc(010);
+    auto count0 = machine->get_instr_count();
+    machine->run();
+    auto step_count = machine->get_instr_count() - count0;
+    EXPECT_EQ(machine->cpu.get_acc(), 0'2222'2222'2222'2222ul);
+
+    // Restore the code and run again with superblocks.
+    store_word(011, besm6_asm("сч 2001, мода"));
+    machine->cpu.reset();
+    machine->set_engine(Machine::Engine::BLOCK);
+    machine->cpu.set_pc(010);
+    count0 = machine->get_instr_count();
+    machine->run();
+    EXPECT_EQ(machine->get_instr_count() - count0, step_count);
+    EXPECT_EQ(machine->cpu.get_acc(), 0'2222'2222'2222'2222ul);
+    EXPECT_EQ(machine->cpu.get_pc(), 012u);
+}
+
+//
+// Memory-reference instructions in all addressing modes, with all engines:
+// direct, indexed, stack, and stack form produced by utc prefix.
+//
+TEST_F(dubna_machine, engine_addressing_modes)
+{
+    // Store the test code.
+    store_word(010, besm6_asm("уиа 2010(17), уиа 1(2)"));
+    store_word(011, besm6_asm("сч 2000, слц 2000(2)"));
+    store_word(012, besm6_asm("зп (17), слц (17)"));
+    store_word(013, besm6_asm("мода -1, слц 1(17)"));
+    store_word(014, besm6_asm("стоп 12345(6), мода")); // Magic opcode: Pass
+    store_word(02000, 1);
+    store_word(02001, 2);
+    store_word(02007, 4);
+
+    for (auto engine : { Machine::Engine::STEP, Machine::Engine::THREADED, Machine::Engine::BLOCK,
+                         Machine::Engine::JIT }) {
+        machine->cpu.reset();
+        machine->set_engine(engine);
+        machine->cpu.set_pc(010);
+        auto count0 = machine->get_instr_count();
+        machine->run();
+        EXPECT_EQ(machine->get_instr_count() - count0, 9u);
+        EXPECT_EQ(machine->cpu.get_acc(), 10u);
+        EXPECT_EQ(machine->cpu.get_pc(), 014u);
+        EXPECT_EQ(machine->cpu.get_m(017), 02007u);
+    }
+}
+
+//
+// Fused utc/wtc prefixes: same results with all engines,
+// including the prefix in right half and the target in the next word,
+// and the target with M[017], which is not popped from stack when modified.
+//
+TEST_F(dubna_machine, engine_fused_prefix)
+{
+    // Store the test code.
+    store_word(010, besm6_asm("уиа 1(2), мода 1"));
+    store_word(011, besm6_asm("сч 2000, мод 2003"));
+    store_word(012, besm6_asm("слц 2000(2), уиа 2000(17)"));
+    store_word(013, besm6_asm("мода 1, сч (17)"));
+    store_word(014, besm6_asm("уиа (3), стоп 12345(6)")); // Magic opcode: Pass
+    store_word(02000, 1);
+    store_word(02001, 2);
+    store_word(02002, 4);
+    store_word(02003, 1);
+    machine->cpu.enable_fused_count(true);
+
+    for (auto engine : { Machine::Engine::STEP, Machine::Engine::THREADED, Machine::Engine::BLOCK,
+                         Machine::Engine::JIT }) {
+        machine->cpu.reset();
+        machine->set_engine(engine);
+        machine->cpu.set_pc(010);
+        auto count0 = machine->get_instr_count();
+        machine->run();
+        EXPECT_EQ(machine->get_instr_count() - count0, 10u);
+        EXPECT_EQ(machine->cpu.get_acc(), 2u);
+        EXPECT_EQ(machine->cpu.get_m(017), 02000u);
+        EXPECT_EQ(machine->cpu.get_pc(), 015u);
+    }
+
+    // Threaded engine and superblocks execute the pairs fused.
+    EXPECT_GE(machine->cpu.get_fused_count(0, 010), 4u);
+    EXPECT_GE(machine->cpu.get_fused_count(1, 013), 2u);
+}
+
+//
+// Left instruction overwrites its own word: the right instruction
+// must be decoded again, though the word was decoded as a pair.
+//
+TEST_F(dubna_machine, decode_pair_self_modifying)
+{
+    // Store the test code.
+    store_word(010, besm6_asm("сч 2000, мода"));
+    store_word(011, besm6_asm("зп 11, сч 2001"));
+    store_word(012, besm6_asm("стоп 12345(6), мода")); // Magic opcode: Pass
+    store_word(02000, besm6_asm("зп 11, сч 2002"));
+    store_word(02001, 0'1111'1111'1111'1111ul);
+    store_word(02002, 0'2222'2222'2222'2222ul);
+
+    for (auto engine : { Machine::Engine::STEP, Machine::Engine::THREADED, Machine::Engine::BLOCK,
+                         Machine::Engine::JIT }) {
+        store_word(011, besm6_asm("зп 11, сч 2001"));
+        machine->cpu.reset();
+        machine->set_engine(engine);
+        machine->cpu.set_pc(010);
+        machine->run();
+        EXPECT_EQ(machine->cpu.get_acc(), 0'2222'2222'2222'2222ul);
+        EXPECT_EQ(machine->cpu.get_pc(), 012u);
+    }
+}
+
+//
+// Counting loop of vlm is skipped in closed form by superblocks:
+// registers and instruction count must match the reference engine.
+//
+TEST_F(dubna_machine, engine_skip_counting_loop)
+{
+    // Store the test code.
+    store_word(010, besm6_asm("уиа -1000(2), уиа -3(3)"));
+    store_word(011, besm6_asm("сч 2000(2), уиа 5(4)"));
+    store_word(012, besm6_asm("уиа 7(5), цикл 11(2)"));
+    store_word(013, besm6_asm("цикл 13(3), мода"));
+    store_word(014, besm6_asm("стоп 12345(6), мода")); // Magic opcode: Pass
+    store_word(02000, 0'1111'1111'1111'1111ul);
+    store_word(01000, 0'2222'2222'2222'2222ul);
+
+    // Run with reference engine.
+    machine->set_engine(Machine::Engine::STEP);
+    machine->cpu.set_pc(010);
+    auto count0 = machine->get_instr_count();
+    machine->run();
+    auto step_count = machine->get_instr_count() - count0;
+    auto step_acc   = machine->cpu.get_acc();
+    EXPECT_EQ(machine->cpu.get_pc(), 014u);
+
+    for (auto engine : { Machine::Engine::BLOCK, Machine::Engine::JIT }) {
+        machine->cpu.reset();
+        machine->set_engine(engine);
+        machine->cpu.set_pc(010);
+        count0 = machine->get_instr_count();
+        machine->run();
+        EXPECT_EQ(machine->get_instr_count() - count0, step_count);
+        EXPECT_EQ(machine->cpu.get_acc(), step_acc);
+        EXPECT_EQ(machine->cpu.get_pc(), 014u);
+        EXPECT_EQ(machine->cpu.get_m(2), 0u);
+        EXPECT_EQ(machine->cpu.get_m(3), 0u);
+        EXPECT_EQ(machine->cpu.get_m(4), 5u);
+        EXPECT_EQ(machine->cpu.get_m(5), 7u);
+    }
+    EXPECT_GE(machine->cpu.get_loop_hits(), 2u);
+
+    // Limit in the middle of the loop is exact.
+    unsigned step_m2 = 0;
+    for (auto engine : { Machine::Engine::STEP, Machine::Engine::BLOCK }) {
+        machine->cpu.reset();
+        machine->set_engine(engine);
+        machine->set_limit(machine->get_instr_count() + 100);
+        machine->cpu.set_pc(010);
+        count0 = machine->get_instr_count();
+        EXPECT_ANY_THROW(machine->run());
+        EXPECT_EQ(machine->get_instr_count() - count0, 101u);
+        if (engine == Machine::Engine::STEP) {
+            step_m2 = machine->cpu.get_m(2);
+        }
+        EXPECT_EQ(machine->cpu.get_m(2), step_m2);
+    }
+}
+
+//
+// Start MS Dubna with superblock and translated engines: superblocks
+// of the monitor are taken from code translated ahead of time, when available.
+// Results must match the interpreter.
+//
+TEST_F(dubna_machine, engine_aot_startjob)
+{
+    // *NAME EMPTY
+    // *END FILE
+    static const Words input = {
+        // clang-format off
+        0'1244'7101'2324'2601,
+        0'2124'6520'2505'4710,
+        0'0242'0040'1002'0012,
+        0'1244'2516'2110'0506,
+        0'2224'6105'6240'5012,
+        0'1245'1105'2024'2040,
+        0'2364'6104'6240'5012,
+        0'1244'2516'2102'0106,
+        0'2224'6105'1014'4412,
+        // clang-format on
+    };
+    machine->disk_mount(030, TEST_DIR "/../tapes/9", false);
+    machine->map_drum_to_disk(021, 030);
+
+    uint64_t step_count = 0;
+    for (auto engine : { Machine::Engine::STEP, Machine::Engine::BLOCK, Machine::Engine::JIT }) {
+        machine->cpu.reset();
+        machine->set_engine(engine);
+        machine->boot_ms_dubna();
+        machine->memory.write_words(input, 04000);
+        machine->drum_io('w', 001, 0, 0, 04000, 1024);
+
+        auto count0 = machine->get_instr_count();
+        machine->run();
+        EXPECT_EQ(machine->cpu.get_pc(), 17u);
+        if (engine == Machine::Engine::STEP) {
+            step_count = machine->get_instr_count() - count0;
+        }
+        EXPECT_EQ(machine->get_instr_count() - count0, step_count);
+    }
+    if (aot_nblocks > 0) {
+        EXPECT_GT(machine->cpu.get_aot_count(), 0u);
+    }
+}
+
+//
+// Pages modified by instructions, by drum i/o and by bulk writes are marked dirty.
+//
+TEST_F(dubna_machine, memory_dirty_pages)
+{
+    // Page 020 is to be read from drum.
+    machine->drum_io('w', 020, 7, 0, 020000, 1024);
+
+    // Store the test code.
+    store_word(010, besm6_asm("xta 2000, atx 5000"));
+    store_word(011, besm6_asm("*70 2001, utc"));
+    store_word(012, besm6_asm("stop 12345(6), utc")); // Magic opcode: Pass
+    store_word(02000, 0'1234'5670'1234'5670ul);
+    store_word(02001, 0'0010'2200'0020'0007ul); // Read drum 20 zone 7 into page 22
+    machine->memory.clear_dirty_pages();
+
+    // Run the code.
+    machine->cpu.set_pc(010);
+    machine->run();
+    EXPECT_EQ(machine->cpu.get_pc(), 012u);
+
+    // Page 2 by atx, page 22 by drum read.
+    EXPECT_EQ(machine->memory.get_dirty_pages(), (1u << 2) | (1u << 022));
+    EXPECT_TRUE(machine->memory.is_page_dirty(022));
+    EXPECT_FALSE(machine->memory.is_page_dirty(0));
+
+    // Bulk write across page boundary.
+    machine->memory.clear_dirty_pages(1u << 2);
+    machine->memory.write_words(Words{ 1, 2 }, 06000 - 1);
+    EXPECT_EQ(machine->memory.get_dirty_pages(), (1u << 2) | (1u << 3) | (1u << 022));
+}
+
+//
+// Watchpoints: log read, write and fetch of watched words to the trace.
+// Accesses to other words are not logged.
+//
+TEST_F(dubna_machine, watchpoints)
+{
+    std::ostringstream trace;
+    machine->redirect_trace(trace, "");
+    machine->add_watchpoint("2000:1:r");
+    machine->add_watchpoint("5000");
+    machine->add_watchpoint("11:x");
+
+    // Store the test code.
+    store_word(010, besm6_asm("xta 2000, atx 5000"));
+    store_word(011, besm6_asm("xta 2001, atx 5001"));
+    store_word(012, besm6_asm("stop 12345(6), utc")); // Magic opcode: Pass
+    store_word(02000, 0'1234'5670'1234'5670ul);
+    store_word(02001, 0'7654'3210'7654'3210ul);
+
+    // Run the code.
+    machine->cpu.set_pc(010);
+    machine->run();
+    EXPECT_EQ(machine->cpu.get_pc(), 012u);
+    EXPECT_EQ(trace.str(),
+              "      Watch Read [02000] = 1234 5670 1234 5670 at 00010 L: 00 010 2000 xta 2000\n"
+              "      Watch Write [05000] = 1234 5670 1234 5670 at 00010 R: 00 000 5000 atx 5000\n"
+              "      Watch Fetch [00011] = 0010 2001 0000 5001 at 00011 L: 00 010 2001 xta 2001\n");
+}
+
+//
+// Watchpoint with stop mode: simulation fails after the access.
+//
+TEST_F(dubna_machine, watchpoint_stop)
+{
+    std::ostringstream trace;
+    machine->redirect_trace(trace, "");
+    machine->add_watchpoint("5001:ws");
+    EXPECT_ANY_THROW(machine->add_watchpoint("5001:q"));
+    EXPECT_ANY_THROW(machine->add_watchpoint("100000"));
+    EXPECT_ANY_THROW(machine->add_watchpoint("77777:2"));
+
+    store_word(010, besm6_asm("xta 2000, atx 5000"));
+    store_word(011, besm6_asm("xta 2001, atx 5001"));
+    store_word(012, besm6_asm("stop 12345(6), utc")); // Magic opcode: Pass
+    store_word(02000, 0'1234'5670'1234'5670ul);
+    store_word(02001, 0'7654'3210'7654'3210ul);
+
+    machine->cpu.set_pc(010);
+    EXPECT_ANY_THROW(machine->run());
+    EXPECT_EQ(machine->cpu.get_pc(), 012u);
+    EXPECT_EQ(machine->memory.load(05001), 0'7654'3210'7654'3210ul);
+    EXPECT_EQ(trace.str(),
+              "      Watch Write [05001] = 7654 3210 7654 3210 at 00011 R: 00 000 5001 atx 5001\n");
+}
+
+//
+// Drum zones are allocated on first write, and read as zeros before that.
+//
+TEST_F(dubna_machine, drum_sparse_zones)
+{
+    EXPECT_EQ(machine->drum_read_word(020, 0), 0u);
+    EXPECT_EQ(machine->get_drum_zone_count(), 0u);
+
+    // Write one word at the end of zone 5.
+    machine->drum_write_word(020, 6 * 1024 - 1, 0'1234'5670'1234'5670ul);
+    EXPECT_EQ(machine->get_drum_zone_count(), 1u);
+    EXPECT_EQ(machine->drum_read_word(020, 6 * 1024 - 1), 0'1234'5670'1234'5670ul);
+
+    // Read across zones 5 and 6: the rest is zeros.
+    machine->memory.write_words(Words{ 7, 7 }, 02000 + 1023);
+    machine->drum_io('r', 020, 5, 3, 02000, 512);
+    EXPECT_EQ(machine->memory.load(02000 + 255), 0'1234'5670'1234'5670ul);
+    EXPECT_EQ(machine->memory.load(02000 + 256), 0u);
+    EXPECT_EQ(machine->memory.load(02000 + 1023), 7u);
+    EXPECT_EQ(machine->get_drum_zone_count(), 1u);
+
+    // Write across zones 6 and 7.
+    machine->drum_io('w', 020, 6, 2, 02000, 1024);
+    EXPECT_EQ(machine->get_drum_zone_count(), 3u);
+    EXPECT_EQ(machine->drum_read_word(020, 6 * 1024 + 512 + 255), 0'1234'5670'1234'5670ul);
+    EXPECT_EQ(machine->drum_read_word(020, 7 * 1024 + 511), 7u);
+}
+
+//
+// Drum mapped from file keeps its contents across machines.
+// Read-only drum discards the changes.
+//
+TEST_F(dubna_machine, drum_file_backed)
+{
+    std::string drum_filename = get_test_name() + ".drum";
+    std::remove(drum_filename.c_str());
+
+    // Write to the drum, then release the machine.
+    machine->drum_mount(020, drum_filename, true);
+    store_word(02000, 0'1234'5670'1234'5670ul);
+    machine->drum_io('w', 020, 3, 1, 02000, 1);
+    EXPECT_ANY_THROW(machine->drum_mount(020, drum_filename, true));
+    machine.reset();
+    EXPECT_EQ(file_contents(drum_filename).size(), 040 * 1024 * sizeof(Word));
+
+    // Read it back, read only.
+    Memory other_memory;
+    machine = std::make_unique<Machine>(other_memory);
+    machine->drum_mount(020, drum_filename, false);
+    EXPECT_EQ(machine->drum_read_word(020, 3 * 1024 + 256), 0'1234'5670'1234'5670ul);
+    machine->drum_write_word(020, 3 * 1024 + 256, 0);
+    EXPECT_EQ(machine->drum_read_word(020, 3 * 1024 + 256), 0u);
+
+    // File is not changed.
+    machine = std::make_unique<Machine>(other_memory);
+    machine->drum_mount(020, drum_filename, false);
+    EXPECT_EQ(machine->drum_read_word(020, 3 * 1024 + 256), 0'1234'5670'1234'5670ul);
+    machine.reset();
+    std::remove(drum_filename.c_str());
+}
+
+//
+// Disk image is mapped into memory: writes reach the file.
+//
+TEST_F(dubna_machine, disk_mapped_write)
+{
+    std::string disk_filename = create_disk_image(2);
+    machine->disk_mount(031, disk_filename, true);
+    store_word(02000, 0'1234'5670'1234'5670ul);
+    machine->disk_io('w', 1, 1, 2, 02000, 256);
+    machine->disk_io('r', 1, 1, 2, 04000, 256);
+    EXPECT_EQ(machine->memory.load(04000), 0'1234'5670'1234'5670ul);
+    EXPECT_ANY_THROW(machine->disk_io('r', 1, 2, 0, 04000, 256));
+    machine.reset();
+
+    // Check the file: zone 1 sector 2, after OS info.
+    DiskImage image(disk_filename, false);
+    EXPECT_TRUE(image.is_mapped());
+    Word word{};
+    image.read(1, 2, &word, 1);
+    EXPECT_EQ(word, 0'1234'5670'1234'5670ul);
+}
+
+//
+// Writable disk with overlay: the image is not changed until commit.
+//
+TEST_F(dubna_machine, disk_overlay)
+{
+    std::string disk_filename = create_disk_image(2);
+    auto image_word = [&]() {
+        DiskImage image(disk_filename, false);
+        Word word{};
+        image.read(1, 2, &word, 1);
+        return word;
+    };
+
+    machine->set_disk_overlay(true);
+    machine->disk_mount(031, disk_filename, true);
+    store_word(02000, 0'1234'5670'1234'5670ul);
+    machine->disk_io('w', 1, 1, 2, 02000, 256);
+
+    // Read from overlay, across zone boundary.
+    machine->disk_io('r', 1, 0, 3, 04000, 1024);
+    EXPECT_EQ(machine->memory.load(04000 + 256 + 8 + 512), 0'1234'5670'1234'5670ul);
+    EXPECT_EQ(image_word(), 0u);
+
+    // Commit to the image.
+    machine->commit_disk_overlays();
+    EXPECT_EQ(image_word(), 0'1234'5670'1234'5670ul);
+}
+
+//
+// Zone cache: read-only disks share zones, writes invalidate them.
+//
+TEST_F(dubna_machine, disk_zone_cache)
+{
+    std::string disk_filename = create_disk_image(2);
+    {
+        DiskImage image(disk_filename, true);
+        Word word = 0'1234'5670'1234'5670ul;
+        image.write(1, 2, &word, 1);
+    }
+
+    // Room for one zone record only.
+    auto cache = std::make_shared<ZoneCache>(DISK_ZONE_NWORDS * sizeof(Word));
+    machine->set_zone_cache(cache);
+    machine->disk_mount(031, disk_filename, false);
+
+    // Writable mount under another name of the same file.
+    machine->disk_mount(032, "./" + disk_filename, true);
+
+    machine->disk_io('r', 1, 1, 2, 02000, 256);
+    machine->disk_io('r', 1, 1, 2, 02000, 256);
+    EXPECT_EQ(machine->memory.load(02000), 0'1234'5670'1234'5670ul);
+    EXPECT_EQ(cache->get_stats().misses, 1u);
+    EXPECT_EQ(cache->get_stats().hits, 1u);
+
+    // Another zone evicts the first one.
+    machine->disk_io('r', 1, 0, 0, 02000, 256);
+    EXPECT_EQ(cache->get_stats().evictions, 1u);
+    machine->disk_io('r', 1, 1, 2, 02000, 256);
+    EXPECT_EQ(cache->get_stats().misses, 3u);
+
+    // Write through the writable mount invalidates the cached zone.
+    store_word(04000, 0'7654'3210'7654'3210ul);
+    machine->disk_io('w', 2, 1, 2, 04000, 1);
+    machine->disk_io('r', 1, 1, 2, 02000, 256);
+    EXPECT_EQ(machine->memory.load(02000), 0'7654'3210'7654'3210ul);
+    EXPECT_EQ(cache->get_stats().misses, 4u);
+    EXPECT_EQ(cache->get_stats().hits, 1u);
+
+    // Statistics of the machine: same, as the cache is not shared.
+    auto stats = machine->get_zone_cache_stats();
+    EXPECT_EQ(stats.misses, 4u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.evictions, 2u);
+}
+
+//
+// Read-ahead: sequential reads from the image request next zones in advance.
+//
+TEST_F(dubna_machine, disk_prefetch)
+{
+    std::string disk_filename = create_disk_image(8);
+    machine->disk_mount(031, disk_filename, false);
+
+    // Sequential zones: next zones are requested in advance, up to the end of disk.
+    for (unsigned zone = 0; zone < 4; zone++) {
+        machine->disk_io('r', 1, zone, 0, 02000, 1024);
+    }
+    EXPECT_EQ(machine->get_disk_prefetch_count(), 6u);
+    EXPECT_EQ(machine->get_disk_prefetch_hits(), 2u);
+
+    // Random access does not prefetch.
+    machine->disk_io('r', 1, 6, 0, 02000, 1024);
+    machine->disk_io('r', 1, 2, 0, 02000, 1024);
+    EXPECT_EQ(machine->get_disk_prefetch_count(), 6u);
+    EXPECT_EQ(machine->get_disk_prefetch_hits(), 3u);
+
+    // Zones served from the cache are not read from the image: no read-ahead.
+    machine->set_zone_cache(std::make_shared<ZoneCache>(8 * DISK_ZONE_NWORDS * sizeof(Word)));
+    machine->disk_mount(032, disk_filename, false);
+    machine->disk_io('r', 2, 0, 0, 02000, 1024);
+    machine->disk_io('r', 2, 1, 0, 02000, 1024);
+    EXPECT_EQ(machine->get_disk_prefetch_count(), 10u);
+    machine->disk_io('r', 2, 0, 0, 02000, 1024);
+    machine->disk_io('r', 2, 1, 0, 02000, 1024);
+    EXPECT_EQ(machine->get_disk_prefetch_count(), 10u);
+    EXPECT_EQ(machine->get_disk_prefetch_hits(), 3u);
+}
+
+//
+// Sync policy: flushes are counted, and written data are visible at once.
+//
+TEST_F(dubna_machine, disk_sync_policy)
+{
+    std::string disk_filename = create_disk_image(2);
+    store_word(02000, 0'1234'5670'1234'5670ul);
+
+    // Start flush every two writes, and complete at the end.
+    Disk disk(machine->memory, disk_filename, true);
+    disk.set_sync_policy(DiskSync::EVERY_N, 2);
+    for (unsigned sector = 0; sector < 3; sector++) {
+        disk.memory_to_disk(1, sector, 02000, 1);
+    }
+    EXPECT_EQ(disk.get_sync_count(), 1u);
+    disk.sync();
+    disk.sync();
+    EXPECT_EQ(disk.get_sync_count(), 2u);
+
+    // No flush by default, but written data are visible at once.
+    disk.set_sync_policy(DiskSync::NONE);
+    disk.memory_to_disk(1, 3, 02000, 1);
+    disk.sync();
+    EXPECT_EQ(disk.get_sync_count(), 2u);
+
+    DiskImage image(disk_filename, false);
+    Word word{};
+    image.read(1, 3, &word, 1);
+    EXPECT_EQ(word, 0'1234'5670'1234'5670ul);
+}
+
+//
+// Write queue of unmapped image: reads see queued data,
+// all writes reach the file when the queue is drained.
+//
+TEST_F(dubna_machine, disk_write_queue)
+{
+    std::string disk_filename = create_disk_image(2);
+    {
+        DiskImage image(disk_filename, true, false);
+        ASSERT_FALSE(image.is_mapped());
+        for (Word word = 0; word < 1024; word++) {
+            image.write(1, word / 256, &word, 1);
+        }
+        Word word{};
+        image.read(1, 3, &word, 1);
+        EXPECT_EQ(word, 1023u);
+
+        // The last write to the sector wins.
+        // Flush requests are queued in order with writes.
+        image.sync(0, image.get_file_size(), false);
+        image.sync(0, image.get_file_size(), true);
+        image.drain();
+    }
+    DiskImage image(disk_filename, false);
+    Word word{};
+    image.read(1, 2, &word, 1);
+    EXPECT_EQ(word, 767u);
+}
@@ -21,7 +21,12 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 //
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 #include <fstream>
+#include <thread>
 
 #include "fixture_session.h"
 
@@ -134,11 +139,9 @@ TEST_F(dubna_session, assem)
 }
 
 //
-// Run *FORTRAN example and check output.
+// Fortran job which prints "Hello, World!".
 //
-TEST_F(dubna_session, fortran)
-{
-    auto output = run_job_and_capture_output(R"(*name фортран
+static const std::string fortran_job = R"(*name фортран
 *fortran
         program hello
         print 1000
@@ -147,7 +150,206 @@ TEST_F(dubna_session, fortran)
         end
 *execute
 *end file
-)");
+)";
+
+//
+// Run *FORTRAN example and check output.
+//
+TEST_F(dubna_session, fortran)
+{
+    auto output = run_job_and_capture_output(fortran_job);
     auto expect = file_contents(TEST_DIR "/output_fortran.expect");
     check_output(output, expect);
 }
+
+//
+// Run *FORTRAN example with threaded engine and check output.
+//
+TEST_F(dubna_session, fortran_threaded_engine)
+{
+    session->set_engine("threaded");
+    auto output = run_job_and_capture_output(fortran_job);
+    auto expect = file_contents(TEST_DIR "/output_fortran.expect");
+    check_output(output, expect);
+}
+
+//
+// Run several jobs at once, each in its own session and thread.
+// Make sure outputs and instruction counts don't interfere.
+//
+TEST_F(dubna_session, concurrent_jobs)
+{
+    struct Job {
+        std::string input;
+        std::string expect_file;
+        std::string output;
+        uint64_t instr_count;
+    };
+    std::vector<Job> jobs = {
+        { "*name окно\n*call ОКНО\n*call ВОКНО\n*end file\n", "/output_okno.expect" },
+        { fortran_job, "/output_fortran.expect" },
+        { fortran_job, "/output_fortran.expect" },
+        { "*name empty\n*end file\n", "" },
+    };
+
+    // Create job files in advance.
+    std::string base_name = get_test_name();
+    for (unsigned i = 0; i < jobs.size(); i++) {
+        create_file(base_name + std::to_string(i) + ".dub", jobs[i].input);
+    }
+
+    // Run all jobs in parallel.
+    auto engine = getenv("DUBNA_ENGINE");
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < jobs.size(); i++) {
+        threads.emplace_back([&, i] {
+            Session job_session;
+            std::ostringstream output;
+            if (engine) {
+                job_session.set_engine(engine);
+            }
+            job_session.set_output(output);
+            job_session.set_job_file(base_name + std::to_string(i) + ".dub");
+            job_session.run();
+            jobs[i].output      = output.str();
+            jobs[i].instr_count = job_session.get_instr_count();
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // Check outputs.
+    for (auto &job : jobs) {
+        if (!job.expect_file.empty()) {
+            check_output(job.output, file_contents(TEST_DIR + job.expect_file));
+        }
+    }
+    EXPECT_GT(jobs[1].instr_count, 0u);
+    EXPECT_EQ(jobs[1].instr_count, jobs[2].instr_count);
+    EXPECT_LT(jobs[3].instr_count, jobs[1].instr_count);
+
+    // Output of other jobs did not leak into the empty job.
+    EXPECT_EQ(jobs[3].output.find("Hello"), std::string::npos);
+}
+
+//
+// Save snapshot of the booted monitor, then start another job from it.
+// Output and instruction count must be the same as without snapshot.
+//
+TEST_F(dubna_session, snapshot_warm_start)
+{
+    std::string base_name     = get_test_name();
+    std::string snapshot_file = base_name + ".snp";
+
+    // Cold start, saving the snapshot.
+    session->save_snapshot(snapshot_file);
+    auto cold_output = run_job_and_capture_output(fortran_job);
+    auto cold_count  = session->get_instr_count();
+    ASSERT_EQ(session->get_exit_status(), EXIT_SUCCESS);
+
+    // Warm start of another session.
+    session = std::make_unique<Session>();
+    if (auto engine = getenv("DUBNA_ENGINE")) {
+        session->set_engine(engine);
+    }
+    session->start_from_snapshot(snapshot_file);
+    auto warm_output = run_job_and_capture_output(fortran_job);
+    ASSERT_EQ(session->get_exit_status(), EXIT_SUCCESS);
+
+    auto expect = file_contents(TEST_DIR "/output_fortran.expect");
+    check_output(cold_output, expect);
+    check_output(warm_output, expect);
+    EXPECT_EQ(session->get_instr_count(), cold_count);
+}
+
+//
+// Take checkpoints while running the job, then roll back and run the tail again.
+// Instruction count and output must be the same as in the first run.
+//
+TEST_F(dubna_session, checkpoint_rollback)
+{
+    session->enable_checkpoints(100'000, 4);
+    auto output = run_job_and_capture_output(fortran_job);
+    auto count = session->get_instr_count();
+    ASSERT_EQ(session->get_exit_status(), EXIT_SUCCESS);
+    ASSERT_EQ(session->get_checkpoint_count(), 4u);
+    EXPECT_LT(session->get_checkpoint_instr_count(3), count);
+
+    // Roll back to the oldest checkpoint and continue.
+    auto from = session->get_checkpoint_instr_count(0);
+    EXPECT_LE(session->get_checkpoint_instr_count(3) - from, 3 * 100'000u + 1000);
+    session->rollback(0);
+    EXPECT_EQ(session->get_instr_count(), from);
+    EXPECT_EQ(session->get_checkpoint_count(), 1u);
+
+    std::ostringstream tail;
+    session->set_output(tail);
+    session->resume();
+    ASSERT_EQ(session->get_exit_status(), EXIT_SUCCESS);
+    EXPECT_EQ(session->get_instr_count(), count);
+    EXPECT_EQ(session->get_checkpoint_count(), 4u);
+
+    // Output of the tail matches the end of the first run.
+    auto body = [](const std::string &str) {
+        const std::string separator = "------------------------------------------------------------\n";
+        auto start = str.find(separator) + separator.size();
+        return str.substr(start, str.find(separator, start) - start);
+    };
+    auto full_body = body(output);
+    auto tail_body = body(tail.str());
+    ASSERT_LE(tail_body.size(), full_body.size());
+    EXPECT_EQ(full_body.substr(full_body.size() - tail_body.size()), tail_body);
+    EXPECT_NE(tail_body.find("HELLO, WORLD!"), std::string::npos);
+}
+
+//
+// Send job to the fork server and return output.
+//
+static std::string submit_job(const std::string &socket_path, const std::string &job)
+{
+    struct sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    socket_path.copy(addr.sun_path, socket_path.size());
+
+    // Wait until the server is ready.
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    for (int retry = 0; connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0; retry++) {
+        if (retry >= 100) {
+            close(fd);
+            return "";
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    EXPECT_EQ(write(fd, job.data(), job.size()), (ssize_t)job.size());
+    shutdown(fd, SHUT_WR);
+
+    std::string output;
+    char buf[4096];
+    ssize_t nbytes;
+    while ((nbytes = read(fd, buf, sizeof(buf))) > 0) {
+        output.append(buf, nbytes);
+    }
+    close(fd);
+    return output;
+}
+
+//
+// Boot once in fork server, and run two jobs from the booted state.
+//
+TEST_F(dubna_session, fork_server)
+{
+    std::string socket_path = get_test_name() + ".sock";
+    std::ostringstream server_output;
+    session->set_output(server_output);
+    std::thread server([&] { session->serve(socket_path, 2); });
+
+    auto fortran_output = submit_job(socket_path, fortran_job);
+    auto okno_output = submit_job(socket_path, "*name окно\n*call ОКНО\n*call ВОКНО\n*end file\n");
+    server.join();
+
+    EXPECT_EQ(session->get_exit_status(), EXIT_SUCCESS);
+    EXPECT_NE(server_output.str().find("Listen on"), std::string::npos);
+    check_output(fortran_output, file_contents(TEST_DIR "/output_fortran.expect"));
+    check_output(okno_output, file_contents(TEST_DIR "/output_okno.expect"));
+}
@@ -27,21 +27,6 @@
 
 #include "machine.h"
 
-//
-// Flag to enable tracing.
-//
-bool Machine::debug_instructions; // trace machine instuctions
-bool Machine::debug_extracodes;   // trace extracodes (except e75)
-bool Machine::debug_print;        // trace extracode e64
-bool Machine::debug_registers;    // trace CPU registers
-bool Machine::debug_memory;       // trace memory read/write
-bool Machine::debug_fetch;        // trace instruction fetch
-
-//
-// Emit trace to this stream.
-//
-std::ofstream Machine::trace_stream;
-
 //
 // Enable trace with given modes.
 //  i - trace instructions
@@ -96,15 +81,17 @@ void Machine::enable_trace(const char *trace_mode)
 //
 void Machine::redirect_trace(const char *file_name, const char *default_mode)
 {
-    if (trace_stream.is_open()) {
+    if (trace_file.is_open()) {
         // Close previous file.
-        trace_stream.close();
+        trace_file.close();
     }
+    trace_stream = nullptr;
     if (file_name && file_name[0]) {
         // Open new trace file.
-        trace_stream.open(file_name);
-        if (!trace_stream.is_open())
+        trace_file.open(file_name);
+        if (!trace_file.is_open())
             throw std::runtime_error("Cannot write to " + std::string(file_name));
+        trace_stream = &trace_file;
     }
 
     if (!trace_enabled()) {
@@ -113,20 +100,30 @@ void Machine::redirect_trace(const char *file_name, const char *default_mode)
     }
 }
 
-std::ostream &Machine::get_trace_stream()
+//
+// Redirect trace output to a given stream, owned by the caller.
+//
+void Machine::redirect_trace(std::ostream &out, const char *default_mode)
+{
+    redirect_trace(nullptr, default_mode);
+    trace_stream = &out;
+}
+
+std::ostream &Machine::get_trace_stream() const
 {
-    if (trace_stream.is_open()) {
-        return trace_stream;
+    if (trace_stream) {
+        return *trace_stream;
     }
-    return std::cout;
+    return *output;
 }
 
 void Machine::close_trace()
 {
-    if (trace_stream.is_open()) {
+    if (trace_file.is_open()) {
         // Close output.
-        trace_stream.close();
+        trace_file.close();
     }
+    trace_stream = nullptr;
 
     // Disable trace options.
     enable_trace("");
@@ -137,7 +134,7 @@ void Machine::close_trace()
 //
 void Machine::print_exception(const char *message)
 {
-    auto &out = Machine::get_trace_stream();
+    auto &out = get_trace_stream();
     out << "--- " << message << std::endl;
 }
 
@@ -146,7 +143,7 @@ void Machine::print_exception(const char *message)
 //
 void Machine::print_fetch(unsigned addr, Word val)
 {
-    auto &out       = Machine::get_trace_stream();
+    auto &out       = get_trace_stream();
     auto save_flags = out.flags();
 
     out << "      Fetch [" << std::oct << std::setfill('0') << std::setw(5) << addr << "] = ";
@@ -164,7 +161,7 @@ void Machine::print_fetch(unsigned addr, Word val)
 //
 void Machine::print_memory_access(unsigned addr, Word val, const char *opname)
 {
-    auto &out       = Machine::get_trace_stream();
+    auto &out       = get_trace_stream();
     auto save_flags = out.flags();
 
     out << "      Memory " << opname << " [" << std::oct << std::setfill('0') << std::setw(5)
@@ -176,12 +173,34 @@ void Machine::print_memory_access(unsigned addr, Word val, const char *opname)
     out.flags(save_flags);
 }
 
+//
+// Print hit of watchpoint, with the instruction which made the access.
+//
+void Machine::print_watch(unsigned addr, Word val, const char *opname, unsigned pc, bool right)
+{
+    auto &out       = get_trace_stream();
+    auto save_flags = out.flags();
+    unsigned rk     = (memory.load(pc) >> (right ? 0 : 24)) & BITS(24);
+
+    out << "      Watch " << opname << " [" << std::oct << std::setfill('0') << std::setw(5)
+        << addr << "] = ";
+    besm6_print_word_octal(out, val);
+    out << " at " << std::setw(5) << pc << ' ' << (right ? 'R' : 'L') << ": ";
+    besm6_print_instruction_octal(out, rk);
+    out << ' ';
+    besm6_print_instruction_mnemonics(out, rk);
+    out << std::endl;
+
+    // Restore.
+    out.flags(save_flags);
+}
+
 //
 // Print instruction address, opcode from RK and mnemonics.
 //
 void Processor::print_instruction()
 {
-    auto &out       = Machine::get_trace_stream();
+    auto &out       = machine.get_trace_stream();
     auto save_flags = out.flags();
 
     out << std::oct << std::setfill('0') << std::setw(5) << core.PC << ' '
@@ -200,7 +219,7 @@ void Processor::print_instruction()
 //
 void Processor::print_registers()
 {
-    auto &out       = Machine::get_trace_stream();
+    auto &out       = machine.get_trace_stream();
     auto save_flags = out.flags();
 
     if (core.ACC != prev.ACC) {
@@ -245,7 +264,7 @@ void Processor::print_registers()
 //
 void Machine::print_e70(const E70_Info &info)
 {
-    auto &out       = Machine::get_trace_stream();
+    auto &out       = get_trace_stream();
     auto save_flags = out.flags();
 
     if (info.disk.unit >= 030 && info.disk.unit < 070) {
@@ -300,7 +319,7 @@ void Machine::print_e70(const E70_Info &info)
 //
 void Machine::print_e64(const E64_Info &info, unsigned start_addr, unsigned end_addr)
 {
-    auto &out       = Machine::get_trace_stream();
+    auto &out       = get_trace_stream();
     auto save_flags = out.flags();
 
     out << "      Print ";